@@ -1,8 +1,18 @@
 #include "cache.hpp"
 
+#include <algorithm>
+#include <array>
+#include <filesystem>
+
+#include "td/utils/misc.h"
 #include "userver/cache/lru_cache_component_base.hpp"
 #include "userver/components/component_context.hpp"
 #include "userver/components/statistics_storage.hpp"
+#include "userver/formats/json/serialize.hpp"
+#include "userver/logging/log.hpp"
+#include "userver/storages/redis/client.hpp"
+#include "userver/storages/redis/component.hpp"
+#include "userver/utils/async.hpp"
 #include "userver/yaml_config/merge_schemas.hpp"
 
 
@@ -31,4 +41,311 @@ properties:
         description: enables dynamic reconfiguration with CacheConfigSet
         defaultDescription: true
 )");
-}
\ No newline at end of file
+}
+
+namespace ton_http::cache {
+RedisCacheApiV2Component::RedisCacheApiV2Component(
+    const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context
+) :
+    ComponentBase(config, context),
+    redis_client_(context.FindComponent<userver::components::Redis>(config["redis-component"].As<std::string>("redis"))
+                      .GetClient(config["db"].As<std::string>())),
+    command_control_(
+        config["timeout"].As<std::chrono::milliseconds>(std::chrono::milliseconds(20)),
+        config["timeout"].As<std::chrono::milliseconds>(std::chrono::milliseconds(20)),
+        1
+    ),
+    key_prefix_(config["key-prefix"].As<std::string>("thacpp")),
+    immutable_ttl_(config["immutable-ttl"].As<std::chrono::milliseconds>(std::chrono::hours(24))) {
+}
+
+std::string RedisCacheApiV2Component::MakeKey(
+    const std::string& request_key, core::CacheMode mode, std::int32_t mc_seqno
+) const {
+  switch (mode) {
+    case core::CacheMode::Immutable:
+      return key_prefix_ + ":i:" + request_key;
+    case core::CacheMode::Timed:
+      return key_prefix_ + ":t:" + request_key;
+    case core::CacheMode::Head:
+      // replicas that observed the same consensus block share entries, older ones just expire
+      return key_prefix_ + ":h:" + std::to_string(mc_seqno) + ":" + request_key;
+  }
+  return {};
+}
+
+std::optional<RedisCachedResponse> RedisCacheApiV2Component::Get(
+    const handlers::TonlibApiRequest& request, std::int32_t mc_seqno
+) const {
+  static constexpr std::array kModes{core::CacheMode::Immutable, core::CacheMode::Timed, core::CacheMode::Head};
+
+  auto request_key = request.ToCacheKey();
+  std::vector<std::string> keys;
+  keys.reserve(kModes.size());
+  for (auto mode : kModes) {
+    keys.push_back(MakeKey(request_key, mode, mc_seqno));
+  }
+  try {
+    auto values = redis_client_->Mget(std::move(keys), command_control_).Get();
+    for (size_t i = 0; i < values.size() && i < kModes.size(); ++i) {
+      if (values[i].has_value()) {
+        return RedisCachedResponse{
+            userver::formats::json::FromString(values[i].value()), kModes[i], values[i]->size()
+        };
+      }
+    }
+  } catch (const std::exception& e) {
+    LOG_WARNING() << "redis cache lookup failed: " << e.what();
+  }
+  return std::nullopt;
+}
+
+void RedisCacheApiV2Component::Put(
+    const handlers::TonlibApiRequest& request,
+    std::string response,
+    std::chrono::milliseconds ttl,
+    std::int32_t mc_seqno,
+    core::CacheMode mode
+) const {
+  if (mode == core::CacheMode::Immutable) {
+    ttl = immutable_ttl_;
+  }
+  try {
+    redis_client_->Set(MakeKey(request.ToCacheKey(), mode, mc_seqno), std::move(response), ttl, command_control_)
+        .IgnoreResult();
+  } catch (const std::exception& e) {
+    LOG_WARNING() << "redis cache store failed: " << e.what();
+  }
+}
+
+userver::yaml_config::Schema RedisCacheApiV2Component::GetStaticConfigSchema() {
+  return userver::yaml_config::MergeSchemas<userver::components::ComponentBase>(R"(
+type: object
+description: Redis-backed shared tier of api/v2 cache
+additionalProperties: false
+properties:
+    redis-component:
+        type: string
+        description: name of userver Redis component
+        defaultDescription: redis
+    db:
+        type: string
+        description: Redis database name from Redis component groups
+    key-prefix:
+        type: string
+        description: prefix for all cache keys
+        defaultDescription: thacpp
+    timeout:
+        type: string
+        description: timeout of single Redis command
+        defaultDescription: 20ms
+    immutable-ttl:
+        type: string
+        description: TTL for immutable responses
+        defaultDescription: 24h
+)");
+}
+
+namespace {
+// approximate size of a generation, survives restarts; cache keys start with a digit, so it can't be overwritten
+constexpr std::string_view kGenerationSizeKey = "#size";
+}  // namespace
+
+struct DiskCacheApiV2Component::Generation {
+  std::uint64_t number;
+  std::string path;
+  std::unique_ptr<td::RocksDb> db;
+  std::atomic<std::uint64_t> size{0};
+  std::atomic<bool> is_full{false};
+  std::atomic<bool> is_retired{false};
+
+  // the last reference to a retired generation removes it from the disk
+  ~Generation() {
+    db.reset();
+    if (is_retired) {
+      std::error_code error;
+      std::filesystem::remove_all(path, error);
+      if (error) {
+        LOG_WARNING() << "failed to remove disk cache generation " << path << ": " << error.message();
+      }
+    }
+  }
+};
+
+DiskCacheApiV2Component::DiskCacheApiV2Component(
+    const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context
+) :
+    ComponentBase(config, context),
+    fs_task_processor_(context.GetTaskProcessor(config["fs-task-processor"].As<std::string>())),
+    path_(config["path"].As<std::string>()),
+    generation_size_(config["max-size-mb"].As<std::uint64_t>(10240) * 1024 * 1024 / 2),
+    write_tasks_(fs_task_processor_) {
+  for (auto& method : config["methods"].As<std::vector<std::string>>()) {
+    methods_.insert(std::move(method));
+  }
+
+  std::filesystem::create_directories(path_);
+  std::vector<std::uint64_t> numbers;
+  for (const auto& entry : std::filesystem::directory_iterator(path_)) {
+    auto number = td::to_integer_safe<std::uint64_t>(entry.path().filename().string());
+    if (entry.is_directory() && number.is_ok()) {
+      numbers.push_back(number.ok());
+    } else if (entry.is_regular_file()) {
+      // files of the database that used to live right in `path`, before it was split into generations
+      std::filesystem::remove(entry.path());
+    }
+  }
+  std::ranges::sort(numbers, std::greater{});
+  for (std::size_t i = 2; i < numbers.size(); ++i) {
+    std::filesystem::remove_all(std::filesystem::path(path_) / std::to_string(numbers[i]));
+  }
+
+  auto r_current = OpenGeneration(numbers.empty() ? 0 : numbers[0]);
+  if (r_current.is_error()) {
+    throw std::runtime_error("failed to open disk cache at " + path_ + ": " + r_current.error().to_string());
+  }
+  current_ = r_current.move_as_ok();
+  if (numbers.size() > 1) {
+    auto r_previous = OpenGeneration(numbers[1]);
+    if (r_previous.is_error()) {
+      throw std::runtime_error("failed to open disk cache at " + path_ + ": " + r_previous.error().to_string());
+    }
+    previous_ = r_previous.move_as_ok();
+  }
+}
+
+td::Result<DiskCacheApiV2Component::GenerationPtr> DiskCacheApiV2Component::OpenGeneration(
+    std::uint64_t number
+) const {
+  auto path = (std::filesystem::path(path_) / std::to_string(number)).string();
+  TRY_RESULT(db, td::RocksDb::open(path));
+  auto generation = std::make_shared<Generation>();
+  generation->number = number;
+  generation->path = std::move(path);
+  generation->db = std::make_unique<td::RocksDb>(std::move(db));
+
+  std::string size;
+  auto r_status = generation->db->get(kGenerationSizeKey, size);
+  if (r_status.is_ok() && r_status.ok() == td::KeyValue::GetStatus::Ok) {
+    if (auto r_size = td::to_integer_safe<std::uint64_t>(size); r_size.is_ok()) {
+      generation->size = r_size.ok();
+    }
+  }
+  return generation;
+}
+
+std::pair<DiskCacheApiV2Component::GenerationPtr, DiskCacheApiV2Component::GenerationPtr>
+DiskCacheApiV2Component::GetGenerations() {
+  std::lock_guard lock(generations_mutex_);
+  return {current_, previous_};
+}
+
+bool DiskCacheApiV2Component::IsPersistable(const handlers::TonlibApiRequest& request) const {
+  return methods_.contains(request.ton_api_method);
+}
+
+std::optional<std::string> DiskCacheApiV2Component::Get(const handlers::TonlibApiRequest& request) {
+  if (!IsPersistable(request)) {
+    return std::nullopt;
+  }
+  auto task = userver::utils::Async(fs_task_processor_, "disk_cache_get", [this, key = request.ToCacheKey()] {
+    auto [current, previous] = GetGenerations();
+    const auto lookup = [&key](const GenerationPtr& generation) {
+      std::optional<std::string> result;
+      std::string value;
+      auto r_status = generation->db->get(key, value);
+      if (r_status.is_error()) {
+        LOG_WARNING() << "disk cache lookup failed: " << r_status.error().to_string();
+      } else if (r_status.ok() == td::KeyValue::GetStatus::Ok) {
+        result = std::move(value);
+      }
+      return result;
+    };
+    auto result = lookup(current);
+    if (!result.has_value() && previous) {
+      result = lookup(previous);
+      if (result.has_value()) {
+        write_tasks_.AsyncDetach("disk_cache_promote", [this, key, response = result.value()] {
+          Store(key, response);
+        });
+      }
+    }
+    return result;
+  });
+  return task.Get();
+}
+
+void DiskCacheApiV2Component::Put(const handlers::TonlibApiRequest& request, std::string response) {
+  if (!IsPersistable(request)) {
+    return;
+  }
+  write_tasks_.AsyncDetach("disk_cache_put", [this, key = request.ToCacheKey(), response = std::move(response)] {
+    Store(key, response);
+  });
+}
+
+void DiskCacheApiV2Component::Store(const std::string& key, const std::string& response) {
+  auto current = GetGenerations().first;
+  auto status = current->db->set(key, response);
+  if (status.is_error()) {
+    LOG_WARNING() << "disk cache store failed: " << status.to_string();
+    return;
+  }
+  // concurrent writers may store the sizes out of order, the persisted one is only an estimate
+  const auto size = current->size.fetch_add(key.size() + response.size()) + key.size() + response.size();
+  if (status = current->db->set(kGenerationSizeKey, std::to_string(size)); status.is_error()) {
+    LOG_WARNING() << "disk cache store failed: " << status.to_string();
+  }
+  if (size >= generation_size_) {
+    Rotate(current);
+  }
+}
+
+void DiskCacheApiV2Component::Rotate(const GenerationPtr& full) {
+  // only the first writer to fill a generation starts the next one
+  if (full->is_full.exchange(true)) {
+    return;
+  }
+  auto r_next = OpenGeneration(full->number + 1);
+  if (r_next.is_error()) {
+    LOG_WARNING() << "failed to start disk cache generation: " << r_next.error().to_string();
+    full->is_full = false;
+    return;
+  }
+  GenerationPtr retired;
+  {
+    std::lock_guard lock(generations_mutex_);
+    retired = std::move(previous_);
+    previous_ = std::move(current_);
+    current_ = r_next.move_as_ok();
+  }
+  if (retired) {
+    retired->is_retired = true;
+  }
+}
+
+userver::yaml_config::Schema DiskCacheApiV2Component::GetStaticConfigSchema() {
+  return userver::yaml_config::MergeSchemas<userver::components::ComponentBase>(R"(
+type: object
+description: persistent cache tier for immutable api/v2 responses
+additionalProperties: false
+properties:
+    path:
+        type: string
+        description: path to RocksDB database directory
+    fs-task-processor:
+        type: string
+        description: task processor for blocking disk operations
+    max-size-mb:
+        type: integer
+        description: disk space the cache may take, the older half is dropped at once when it is reached
+        defaultDescription: 10240
+    methods:
+        type: array
+        description: lowercase api/v2 methods which immutable responses are persisted
+        items:
+          type: string
+          description: api/v2 method name
+)");
+}
+}  // namespace ton_http::cache
@@ -1,11 +1,21 @@
 #pragma once
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <map>
+#include <mutex>
+#include <unordered_set>
 
 #include "request.hpp"
+#include "td/db/RocksDb.h"
 #include "userver/cache/expirable_lru_cache.hpp"
 #include "userver/components/component_base.hpp"
 #include "userver/components/component_context.hpp"
 #include "userver/components/statistics_storage.hpp"
+#include "userver/concurrent/background_task_storage.hpp"
+#include "userver/engine/mutex.hpp"
+#include "userver/storages/redis/client_fwd.hpp"
+#include "userver/storages/redis/command_control.hpp"
 #include "userver/utils/statistics/entry.hpp"
 #include "userver/yaml_config/schema.hpp"
 
@@ -56,18 +66,196 @@ private:
   userver::utils::statistics::Entry statistics_holder_;
 };
 
-class CacheApiV2Component final : public ExpirableLruCacheComponent<handlers::TonlibApiRequest, userver::formats::json::Value> {
+struct EncodedApiV2Body {
+  std::string body;
+  // empty for bodies sent as is
+  std::string content_encoding;
+};
+
+// Bodies of a cached response as they are served on hits, one per format and content encoding. Each one
+// is made by the first hit asking for it, the copies of the entry handed out by the cache share them.
+class EncodedApiV2Bodies {
+public:
+  EncodedApiV2Body Get(const std::string& variant, const std::function<EncodedApiV2Body()>& make) {
+    {
+      std::lock_guard lock(mutex_);
+      if (auto it = bodies_.find(variant); it != bodies_.end()) {
+        return it->second;
+      }
+    }
+    // hits racing for a new variant may encode it more than once, only the first result is kept
+    auto body = make();
+    std::lock_guard lock(mutex_);
+    return bodies_.try_emplace(variant, std::move(body)).first->second;
+  }
+
+private:
+  userver::engine::Mutex mutex_;
+  std::map<std::string, EncodedApiV2Body> bodies_;
+};
+using EncodedApiV2BodiesPtr = std::shared_ptr<EncodedApiV2Bodies>;
+
+struct StoredApiV2Response {
+  userver::formats::json::Value response;
+  // null for responses that don't come from an in-process cache
+  EncodedApiV2BodiesPtr bodies{nullptr};
+};
+
+struct CachedApiV2Response {
+  userver::formats::json::Value response;
+  std::chrono::steady_clock::time_point expires_at;
+  // entry may still be served after expiry while one refresh is in flight
+  std::chrono::steady_clock::time_point stale_until;
+  // consensus masterchain seqno at the moment the request was started
+  std::int32_t mc_seqno{0};
+  bool is_block_bound{true};
+  std::shared_ptr<std::atomic<bool>> is_refreshing{nullptr};
+  EncodedApiV2BodiesPtr bodies{nullptr};
+};
+
+struct CacheApiV2Lookup {
+  StoredApiV2Response stored;
+  // set if the entry is stale and the caller won the right to refresh it, reset it if refresh fails
+  std::shared_ptr<std::atomic<bool>> refresh{nullptr};
+};
+
+class CacheApiV2Component final : public ExpirableLruCacheComponent<handlers::TonlibApiRequest, CachedApiV2Response> {
 public:
   static constexpr std::string_view kName = "cache-api-v2";
   CacheApiV2Component(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
     : ExpirableLruCacheComponent(config, context) {};
+
+  // entries live for their own TTL (bounded by cache lifetime), block-bound ones also
+  // only while no newer consensus block is observed
+  std::optional<CacheApiV2Lookup> Get(const handlers::TonlibApiRequest& request, std::int32_t mc_seqno) {
+    auto cached = ExpirableLruCacheComponent::Get(request);
+    if (!cached.has_value()) {
+      return std::nullopt;
+    }
+    auto now = std::chrono::steady_clock::now();
+    bool is_fresh = cached->expires_at > now && !(cached->is_block_bound && cached->mc_seqno < mc_seqno);
+    if (is_fresh) {
+      return CacheApiV2Lookup{{std::move(cached->response), std::move(cached->bodies)}};
+    }
+    if (!cached->is_refreshing || cached->stale_until <= now) {
+      return std::nullopt;
+    }
+    CacheApiV2Lookup result{{std::move(cached->response), std::move(cached->bodies)}};
+    if (!cached->is_refreshing->exchange(true)) {
+      result.refresh = std::move(cached->is_refreshing);
+    }
+    return result;
+  }
+  void Put(
+      const handlers::TonlibApiRequest& request,
+      const userver::formats::json::Value& response,
+      std::chrono::milliseconds ttl,
+      std::chrono::milliseconds stale_ttl,
+      std::int32_t mc_seqno,
+      bool is_block_bound = true
+  ) {
+    auto expires_at = std::chrono::steady_clock::now() + ttl;
+    ExpirableLruCacheComponent::Put(
+        request,
+        CachedApiV2Response{
+            response,
+            expires_at,
+            expires_at + stale_ttl,
+            mc_seqno,
+            is_block_bound,
+            stale_ttl.count() > 0 ? std::make_shared<std::atomic<bool>>(false) : nullptr,
+            std::make_shared<EncodedApiV2Bodies>()
+        }
+    );
+  }
 };
 
-class ConstCacheApiV2Component final : public ExpirableLruCacheComponent<handlers::TonlibApiRequest, userver::formats::json::Value> {
+// Responses that can never change, sized separately so history lookups don't evict head state.
+// The cache is bounded by entries, so large responses (long streamed lists) are left to the disk and Redis tiers.
+// An entry takes about 3x its json size as a parsed value plus up to six encoded bodies, ~50 KB for typical
+// responses of 2-30 KB and at most ~2.5 MB.
+class ConstCacheApiV2Component final : public ExpirableLruCacheComponent<handlers::TonlibApiRequest, StoredApiV2Response> {
 public:
   static constexpr std::string_view kName = "const-cache-api-v2";
+  static constexpr std::size_t kMaxResponseSize = 512 * 1024;
+
   ConstCacheApiV2Component(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context)
     : ExpirableLruCacheComponent(config, context) {};
+
+  // `response_size` is the size of the serialized response
+  void Put(const handlers::TonlibApiRequest& request, const userver::formats::json::Value& response, std::size_t response_size) {
+    if (response_size > kMaxResponseSize) {
+      return;
+    }
+    ExpirableLruCacheComponent::Put(request, StoredApiV2Response{response, std::make_shared<EncodedApiV2Bodies>()});
+  }
+};
+
+struct RedisCachedResponse {
+  userver::formats::json::Value response;
+  core::CacheMode mode;
+  std::size_t size;
+};
+
+// optional shared tier behind the in-process caches, lets replicas reuse each other's responses
+class RedisCacheApiV2Component final : public userver::components::ComponentBase {
+public:
+  static constexpr std::string_view kName = "redis-cache-api-v2";
+  RedisCacheApiV2Component(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context);
+
+  static userver::yaml_config::Schema GetStaticConfigSchema();
+
+  std::optional<RedisCachedResponse> Get(const handlers::TonlibApiRequest& request, std::int32_t mc_seqno) const;
+  void Put(
+      const handlers::TonlibApiRequest& request,
+      std::string response,
+      std::chrono::milliseconds ttl,
+      std::int32_t mc_seqno,
+      core::CacheMode mode
+  ) const;
+private:
+  std::string MakeKey(const std::string& request_key, core::CacheMode mode, std::int32_t mc_seqno) const;
+
+  userver::storages::redis::ClientPtr redis_client_;
+  userver::storages::redis::CommandControl command_control_;
+  std::string key_prefix_;
+  std::chrono::milliseconds immutable_ttl_;
+};
+
+// Persistent cache tier for immutable api/v2 responses. Responses go to the current generation, a RocksDB
+// database in a numbered subdirectory of `path`. Once it holds half of max-size-mb, the previous generation is
+// deleted as a whole and a new current one is started, so the cache never takes much more than max-size-mb.
+// Hits in the previous generation are copied to the current one, so hot entries outlive the rotation.
+class DiskCacheApiV2Component final : public userver::components::ComponentBase {
+public:
+  static constexpr std::string_view kName = "disk-cache-api-v2";
+  DiskCacheApiV2Component(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context);
+
+  static userver::yaml_config::Schema GetStaticConfigSchema();
+
+  // serialized response
+  std::optional<std::string> Get(const handlers::TonlibApiRequest& request);
+  void Put(const handlers::TonlibApiRequest& request, std::string response);
+private:
+  struct Generation;
+  using GenerationPtr = std::shared_ptr<Generation>;
+
+  [[nodiscard]] bool IsPersistable(const handlers::TonlibApiRequest& request) const;
+  [[nodiscard]] td::Result<GenerationPtr> OpenGeneration(std::uint64_t number) const;
+  [[nodiscard]] std::pair<GenerationPtr, GenerationPtr> GetGenerations();
+  // blocking, called on the fs task processor
+  void Store(const std::string& key, const std::string& response);
+  void Rotate(const GenerationPtr& full);
+
+  userver::engine::TaskProcessor& fs_task_processor_;
+  std::unordered_set<std::string> methods_;
+  std::string path_;
+  std::uint64_t generation_size_;
+  userver::engine::Mutex generations_mutex_;
+  GenerationPtr current_;
+  GenerationPtr previous_;
+  // must be the last member, pending writes are cancelled before the database is closed
+  userver::concurrent::BackgroundTaskStorage write_tasks_;
 };
 // clang-format off
 }
@@ -0,0 +1,124 @@
+#include "cbor.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <optional>
+
+#include "compression.hpp"
+#include "td/utils/base64.h"
+
+namespace ton_http::utils {
+namespace {
+enum MajorType : unsigned char {
+  kUnsigned = 0,
+  kNegative = 1,
+  kByteString = 2,
+  kTextString = 3,
+  kArray = 4,
+  kMap = 5,
+};
+constexpr unsigned char kFalse = 0xf4;
+constexpr unsigned char kTrue = 0xf5;
+constexpr unsigned char kNull = 0xf6;
+constexpr unsigned char kDouble = 0xfb;
+
+// fields of tonlib objects that hold a base64 bag of cells: raw.fullAccountState, raw.transaction, msg.dataRaw
+// and tvm.cell / tvm.slice. Only objects with a @type are tonlib ones, the content of jettons has a data too.
+constexpr std::array<std::string_view, 5> kBocFields = {"code", "data", "body", "init_state", "bytes"};
+
+void write_big_endian(std::string& out, std::uint64_t value, std::size_t size) {
+  for (std::size_t i = size; i > 0; --i) {
+    out += static_cast<char>((value >> (8 * (i - 1))) & 0xff);
+  }
+}
+
+void write_head(std::string& out, MajorType type, std::uint64_t value) {
+  const auto major = static_cast<unsigned char>(type << 5);
+  if (value < 24) {
+    out += static_cast<char>(major | value);
+  } else if (value <= 0xff) {
+    out += static_cast<char>(major | 24);
+    write_big_endian(out, value, 1);
+  } else if (value <= 0xffff) {
+    out += static_cast<char>(major | 25);
+    write_big_endian(out, value, 2);
+  } else if (value <= 0xffffffff) {
+    out += static_cast<char>(major | 26);
+    write_big_endian(out, value, 4);
+  } else {
+    out += static_cast<char>(major | 27);
+    write_big_endian(out, value, 8);
+  }
+}
+
+void write_string(std::string& out, const std::string& str, bool is_boc) {
+  if (is_boc) {
+    if (auto r_boc = td::base64_decode(str); r_boc.is_ok()) {
+      write_head(out, kByteString, r_boc.ok().size());
+      out += r_boc.ok();
+      return;
+    }
+  }
+  write_head(out, kTextString, str.size());
+  out += str;
+}
+
+void write_value(std::string& out, const userver::formats::json::Value& value, bool is_boc = false) {
+  if (value.IsNull()) {
+    out += static_cast<char>(kNull);
+  } else if (value.IsBool()) {
+    out += static_cast<char>(value.As<bool>() ? kTrue : kFalse);
+  } else if (value.IsUInt64()) {
+    write_head(out, kUnsigned, value.As<std::uint64_t>());
+  } else if (value.IsInt64()) {
+    // negative integers are stored as -1 - n
+    write_head(out, kNegative, static_cast<std::uint64_t>(-(value.As<std::int64_t>() + 1)));
+  } else if (value.IsDouble()) {
+    out += static_cast<char>(kDouble);
+    write_big_endian(out, std::bit_cast<std::uint64_t>(value.As<double>()), 8);
+  } else if (value.IsString()) {
+    write_string(out, value.As<std::string>(), is_boc);
+  } else if (value.IsArray()) {
+    write_head(out, kArray, value.GetSize());
+    for (const auto& item : value) {
+      write_value(out, item);
+    }
+  } else if (value.IsObject()) {
+    const bool is_tonlib_object = value.HasMember("@type");
+    write_head(out, kMap, value.GetSize());
+    for (auto it = value.begin(); it != value.end(); ++it) {
+      write_head(out, kTextString, it.GetName().size());
+      out += it.GetName();
+      write_value(out, *it, is_tonlib_object && std::ranges::find(kBocFields, it.GetName()) != kBocFields.end());
+    }
+  }
+}
+}  // namespace
+
+std::string to_cbor(const userver::formats::json::Value& value) {
+  std::string out;
+  write_value(out, value);
+  return out;
+}
+
+bool prefers_cbor(std::string_view accept) {
+  std::optional<double> cbor;
+  std::optional<double> json;
+  std::optional<double> application;
+  std::optional<double> any;
+  for (const auto& [media_range, quality] : parse_quality_list(accept)) {
+    if (media_range == "application/cbor") {
+      cbor = quality;
+    } else if (media_range == "application/json") {
+      json = quality;
+    } else if (media_range == "application/*") {
+      application = quality;
+    } else if (media_range == "*/*") {
+      any = quality;
+    }
+  }
+  // cbor is sent only to clients that name it, json matches the wildcards too
+  return cbor.value_or(0) > 0 && cbor.value() >= json.value_or(application.value_or(any.value_or(0)));
+}
+}  // namespace ton_http::utils
@@ -0,0 +1,13 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include <userver/formats/json.hpp>
+
+namespace ton_http::utils {
+// CBOR (RFC 8949) encoding of a json response with the same schema. The base64 bag of cells fields of tonlib
+// objects (code, data, body, init_state, bytes of a value with @type) are always written as byte strings with
+// the raw BOC, everything else keeps its json type.
+std::string to_cbor(const userver::formats::json::Value& value);
+// true if an Accept header allows cbor with a q-value not lower than the one of json
+bool prefers_cbor(std::string_view accept);
+}
@@ -0,0 +1,201 @@
+#include "compression.hpp"
+
+#include <zlib.h>
+#include <zstd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <stdexcept>
+
+#include "td/utils/Gzip.h"
+
+namespace ton_http::utils {
+namespace {
+// smaller bodies fit into a packet anyway
+constexpr std::size_t kMinCompressedSize = 1024;
+// compressed bodies are cached, so the ratio matters more than the speed of a single call
+constexpr int kZstdLevel = 6;
+// a compressed body larger than this part of the original one is not worth decoding on the client
+constexpr double kMaxCompressionRatio = 0.9;
+// streamed bodies are compressed once per request, so speed wins over the ratio
+constexpr int kZstdStreamLevel = 3;
+// gzip wrapper around the deflate stream
+constexpr int kGzipWindowBits = 15 + 16;
+constexpr int kGzipMemLevel = 8;
+constexpr std::size_t kGzipOutputSize = 16384;
+
+std::string_view trim(std::string_view str) {
+  while (!str.empty() && (str.front() == ' ' || str.front() == '\t')) {
+    str.remove_prefix(1);
+  }
+  while (!str.empty() && (str.back() == ' ' || str.back() == '\t')) {
+    str.remove_suffix(1);
+  }
+  return str;
+}
+
+}  // namespace
+
+std::vector<std::pair<std::string, double>> parse_quality_list(std::string_view header) {
+  std::vector<std::pair<std::string, double>> items;
+  while (!header.empty()) {
+    const auto end = std::min(header.find(','), header.size());
+    const auto item = header.substr(0, end);
+    header.remove_prefix(std::min(end + 1, header.size()));
+
+    const auto params = item.find(';');
+    std::string name{trim(item.substr(0, params))};
+    if (name.empty()) {
+      continue;
+    }
+    std::ranges::transform(name, name.begin(), [](unsigned char c) { return std::tolower(c); });
+    double quality = 1;
+    if (params != std::string_view::npos) {
+      if (auto q = item.find("q=", params); q != std::string_view::npos) {
+        quality = std::strtod(std::string(item.substr(q + 2)).c_str(), nullptr);
+      }
+    }
+    items.emplace_back(std::move(name), quality);
+  }
+  return items;
+}
+
+ContentEncoding negotiate_content_encoding(std::string_view accept_encoding) {
+  std::optional<bool> zstd;
+  std::optional<bool> gzip;
+  std::optional<bool> any;
+  for (const auto& [coding, quality] : parse_quality_list(accept_encoding)) {
+    // codings with q=0 are explicitly refused
+    const bool is_allowed = quality > 0;
+    if (coding == "zstd") {
+      zstd = is_allowed;
+    } else if (coding == "gzip" || coding == "x-gzip") {
+      gzip = is_allowed;
+    } else if (coding == "*") {
+      any = is_allowed;
+    }
+  }
+  if (zstd.value_or(any.value_or(false))) {
+    return ContentEncoding::Zstd;
+  }
+  if (gzip.value_or(any.value_or(false))) {
+    return ContentEncoding::Gzip;
+  }
+  return ContentEncoding::Identity;
+}
+
+std::string_view content_encoding_name(ContentEncoding encoding) {
+  switch (encoding) {
+    case ContentEncoding::Identity:
+      return "";
+    case ContentEncoding::Gzip:
+      return "gzip";
+    case ContentEncoding::Zstd:
+      return "zstd";
+  }
+  return "";
+}
+
+std::optional<std::string> compress(std::string_view body, ContentEncoding encoding) {
+  if (encoding == ContentEncoding::Identity || body.size() < kMinCompressedSize) {
+    return std::nullopt;
+  }
+  if (encoding == ContentEncoding::Gzip) {
+    auto compressed = td::gzencode(td::Slice(body.data(), body.size()), kMaxCompressionRatio);
+    if (compressed.empty()) {
+      return std::nullopt;
+    }
+    return compressed.as_slice().str();
+  }
+
+  std::string compressed(ZSTD_compressBound(body.size()), '\0');
+  const auto size = ZSTD_compress(compressed.data(), compressed.size(), body.data(), body.size(), kZstdLevel);
+  if (ZSTD_isError(size) || static_cast<double>(size) > static_cast<double>(body.size()) * kMaxCompressionRatio) {
+    return std::nullopt;
+  }
+  compressed.resize(size);
+  return compressed;
+}
+
+struct StreamCompressor::Impl {
+  ContentEncoding encoding{ContentEncoding::Identity};
+  ZSTD_CCtx* zstd{nullptr};
+  z_stream gzip{};
+
+  ~Impl() {
+    if (encoding == ContentEncoding::Zstd) {
+      ZSTD_freeCCtx(zstd);
+    } else if (encoding == ContentEncoding::Gzip) {
+      deflateEnd(&gzip);
+    }
+  }
+
+  std::string CompressZstd(std::string_view chunk, bool is_last) {
+    std::string out;
+    ZSTD_inBuffer input{chunk.data(), chunk.size(), 0};
+    std::size_t remaining = 0;
+    do {
+      const auto offset = out.size();
+      out.resize(offset + ZSTD_CStreamOutSize());
+      ZSTD_outBuffer output{out.data() + offset, out.size() - offset, 0};
+      remaining = ZSTD_compressStream2(zstd, &output, &input, is_last ? ZSTD_e_end : ZSTD_e_flush);
+      out.resize(offset + output.pos);
+      if (ZSTD_isError(remaining)) {
+        throw std::runtime_error(std::string("zstd stream: ") + ZSTD_getErrorName(remaining));
+      }
+    } while (remaining != 0);
+    return out;
+  }
+
+  std::string CompressGzip(std::string_view chunk, bool is_last) {
+    std::string out;
+    gzip.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(chunk.data()));
+    gzip.avail_in = static_cast<uInt>(chunk.size());
+    do {
+      const auto offset = out.size();
+      out.resize(offset + kGzipOutputSize);
+      gzip.next_out = reinterpret_cast<Bytef*>(out.data() + offset);
+      gzip.avail_out = static_cast<uInt>(kGzipOutputSize);
+      if (deflate(&gzip, is_last ? Z_FINISH : Z_SYNC_FLUSH) == Z_STREAM_ERROR) {
+        throw std::runtime_error("gzip stream: deflate failed");
+      }
+      out.resize(out.size() - gzip.avail_out);
+    } while (gzip.avail_out == 0);
+    return out;
+  }
+};
+
+StreamCompressor::StreamCompressor(ContentEncoding encoding) : impl_(std::make_unique<Impl>()) {
+  if (encoding == ContentEncoding::Zstd) {
+    impl_->zstd = ZSTD_createCCtx();
+    if (impl_->zstd != nullptr) {
+      ZSTD_CCtx_setParameter(impl_->zstd, ZSTD_c_compressionLevel, kZstdStreamLevel);
+      impl_->encoding = encoding;
+    }
+  } else if (encoding == ContentEncoding::Gzip) {
+    if (deflateInit2(&impl_->gzip, Z_DEFAULT_COMPRESSION, Z_DEFLATED, kGzipWindowBits, kGzipMemLevel,
+                     Z_DEFAULT_STRATEGY) == Z_OK) {
+      impl_->encoding = encoding;
+    }
+  }
+}
+
+StreamCompressor::~StreamCompressor() = default;
+
+ContentEncoding StreamCompressor::Encoding() const {
+  return impl_->encoding;
+}
+
+std::string StreamCompressor::Compress(std::string_view chunk, bool is_last) {
+  switch (impl_->encoding) {
+    case ContentEncoding::Identity:
+      return std::string{chunk};
+    case ContentEncoding::Gzip:
+      return impl_->CompressGzip(chunk, is_last);
+    case ContentEncoding::Zstd:
+      return impl_->CompressZstd(chunk, is_last);
+  }
+  return std::string{chunk};
+}
+}  // namespace ton_http::utils
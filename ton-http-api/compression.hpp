@@ -0,0 +1,38 @@
+#pragma once
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace ton_http::utils {
+enum class ContentEncoding { Identity, Gzip, Zstd };
+
+// lowercase items of a header like Accept or Accept-Encoding with their q-values, 1 when not given
+std::vector<std::pair<std::string, double>> parse_quality_list(std::string_view header);
+// the best content coding allowed by an Accept-Encoding header, zstd is preferred over gzip
+ContentEncoding negotiate_content_encoding(std::string_view accept_encoding);
+// value of the Content-Encoding header, empty for identity
+std::string_view content_encoding_name(ContentEncoding encoding);
+// compressed body, nullopt if the body is better sent as is
+std::optional<std::string> compress(std::string_view body, ContentEncoding encoding);
+
+// Compresses a body sent in chunks. Every chunk is flushed, so the client can decode everything it has got so far.
+class StreamCompressor {
+public:
+  // falls back to identity if the encoder fails to start
+  explicit StreamCompressor(ContentEncoding encoding);
+  ~StreamCompressor();
+  StreamCompressor(const StreamCompressor&) = delete;
+  StreamCompressor& operator=(const StreamCompressor&) = delete;
+
+  [[nodiscard]] ContentEncoding Encoding() const;
+  // compressed form of the next chunk, the last one closes the stream; throws std::runtime_error
+  std::string Compress(std::string_view chunk, bool is_last = false);
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
+};
+}
@@ -0,0 +1,76 @@
+#include "contract_cache.h"
+
+#include <algorithm>
+#include <iterator>
+#include <mutex>
+
+namespace ton_http::core {
+
+std::size_t ContractCache::KeyHash::operator()(const Key& key) const {
+  auto res = std::hash<std::string>{}(key.address);
+  res ^= std::hash<ton::BlockSeqno>{}(key.seqno) + 0x9e3779b9 + (res << 6) + (res >> 2);
+  res ^= std::hash<bool>{}(key.is_head) + 0x9e3779b9 + (res << 6) + (res >> 2);
+  return res;
+}
+
+ContractHandlePtr ContractCache::Get(const Key& key, const multiclient::SessionPtr& session) {
+  std::lock_guard lock(mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end()) {
+    return nullptr;
+  }
+  auto handle = it->second->second;
+  if (session) {
+    const auto& workers = session->active_workers();
+    const auto worker_index = handle->session->active_workers().front();
+    if (std::ranges::find(workers, worker_index) == workers.end()) {
+      return nullptr;
+    }
+  }
+  lru_.splice(lru_.begin(), lru_, it->second);
+  return handle;
+}
+
+void ContractCache::Put(const Key& key, ContractHandlePtr handle) {
+  std::lock_guard lock(mutex_);
+  if (auto it = index_.find(key); it != index_.end()) {
+    retired_.push_back(std::move(it->second->second));
+    lru_.erase(it->second);
+    index_.erase(it);
+  }
+  lru_.emplace_front(key, std::move(handle));
+  index_.emplace(key, lru_.begin());
+  while (lru_.size() > capacity_) {
+    auto& [evicted_key, evicted_handle] = lru_.back();
+    index_.erase(evicted_key);
+    retired_.push_back(std::move(evicted_handle));
+    lru_.pop_back();
+  }
+}
+
+void ContractCache::Invalidate(const Key& key, const ContractHandlePtr& handle) {
+  std::lock_guard lock(mutex_);
+  auto it = index_.find(key);
+  if (it == index_.end() || it->second->second != handle) {
+    return;
+  }
+  retired_.push_back(std::move(it->second->second));
+  lru_.erase(it->second);
+  index_.erase(it);
+}
+
+void ContractCache::Retire(ContractHandlePtr handle) {
+  std::lock_guard lock(mutex_);
+  retired_.push_back(std::move(handle));
+}
+
+std::vector<ContractHandlePtr> ContractCache::TakeReleased() {
+  std::lock_guard lock(mutex_);
+  std::vector<ContractHandlePtr> released;
+  // retired handles can't be obtained anymore, so the use count may only decrease
+  auto it = std::partition(retired_.begin(), retired_.end(), [](const auto& handle) { return handle.use_count() > 1; });
+  std::move(it, retired_.end(), std::back_inserter(released));
+  retired_.erase(it, retired_.end());
+  return released;
+}
+}  // namespace ton_http::core
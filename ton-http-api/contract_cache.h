@@ -0,0 +1,60 @@
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "tonlib-multiclient/multi_client.h"
+#include "ton/ton-types.h"
+#include "userver/engine/mutex.hpp"
+
+namespace ton_http::core {
+
+// contract loaded with smc_load, the id is only valid on the tonlib worker the session is pinned to
+struct ContractHandle {
+  std::int64_t id;
+  multiclient::SessionPtr session;
+};
+using ContractHandlePtr = std::shared_ptr<const ContractHandle>;
+
+// LRU of loaded contracts shared between requests.
+// Evicted handles are retired rather than dropped: they may still be in use by a running request,
+// so they are handed out for smc_forget only once the cache holds the last reference.
+class ContractCache {
+public:
+  struct Key {
+    std::string address;  // raw form
+    ton::BlockSeqno seqno;  // requested block or consensus block for the latest state
+    bool is_head;
+
+    bool operator==(const Key& other) const = default;
+  };
+
+  explicit ContractCache(std::size_t capacity) : capacity_(capacity) {}
+
+  [[nodiscard]] bool IsEnabled() const {
+    return capacity_ > 0;
+  }
+  // returns nullptr if there is no handle or it belongs to a worker outside the given session
+  ContractHandlePtr Get(const Key& key, const multiclient::SessionPtr& session);
+  void Put(const Key& key, ContractHandlePtr handle);
+  // drops the handle if it is still cached under the key, f.e. after a failed get method
+  void Invalidate(const Key& key, const ContractHandlePtr& handle);
+  // handles that are not cached anymore and have to be released with smc_forget
+  void Retire(ContractHandlePtr handle);
+  std::vector<ContractHandlePtr> TakeReleased();
+
+private:
+  struct KeyHash {
+    std::size_t operator()(const Key& key) const;
+  };
+  using Entry = std::pair<Key, ContractHandlePtr>;
+
+  const std::size_t capacity_;
+  userver::engine::Mutex mutex_;
+  std::list<Entry> lru_;
+  std::unordered_map<Key, std::list<Entry>::iterator, KeyHash> index_;
+  std::vector<ContractHandlePtr> retired_;
+};
+}  // namespace ton_http::core
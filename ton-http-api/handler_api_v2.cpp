@@ -1,9 +1,13 @@
 #include "handler_api_v2.h"
 
+#include <algorithm>
+#include <array>
 #include <ranges>
 
 #include "auto/tl/tonlib_api.h"
 #include "auto/tl/tonlib_api_json.h"
+#include "cbor.hpp"
+#include "compression.hpp"
 #include "http/http.h"
 #include "openapi/openapi_page.hpp"
 #include "td/utils/JsonBuilder.h"
@@ -14,9 +18,280 @@
 #include "userver/http/common_headers.hpp"
 #include "userver/logging/component.hpp"
 #include "userver/logging/log.hpp"
+#include "userver/server/request/task_inherited_data.hpp"
 #include "utils.hpp"
 
 namespace ton_http::handlers {
+namespace {
+struct BlockTransactionsArgs {
+  ton::WorkchainId workchain;
+  ton::ShardId shard;
+  ton::BlockSeqno seqno;
+  std::string root_hash;
+  std::string file_hash;
+  std::optional<ton::LogicalTime> after_lt;
+  std::string after_hash;
+  std::int32_t count;
+  std::optional<bool> archival;
+};
+
+td::Result<BlockTransactionsArgs> parse_block_transactions_args(const TonlibApiRequest& request) {
+  auto workchain = utils::stringToInt<ton::WorkchainId>(request.GetArg("workchain"));
+  auto shard = utils::stringToInt<ton::ShardId>(request.GetArg("shard"));
+  auto seqno = utils::stringToInt<ton::BlockSeqno>(request.GetArg("seqno"));
+  auto root_hash = utils::stringToHash(request.GetArg("root_hash"));
+  auto file_hash = utils::stringToHash(request.GetArg("file_hash"));
+  auto after_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("after_lt"));
+  auto after_hash = utils::stringToHash(request.GetArg("after_hash"));
+  auto count = utils::stringToInt<std::int32_t>(request.GetArg("count"));
+
+  if (!workchain.has_value()) {
+    return td::Status::Error(422, "workchain is required");
+  }
+  if (!shard.has_value()) {
+    return td::Status::Error(422, "shard is required");
+  }
+  if (!seqno.has_value()) {
+    return td::Status::Error(422, "seqno is required");
+  }
+  if (!root_hash.has_value()) {
+    return td::Status::Error(422, "failed to parse root_hash");
+  }
+  if (!file_hash.has_value()) {
+    return td::Status::Error(422, "failed to parse file_hash");
+  }
+  if (!after_hash.has_value()) {
+    return td::Status::Error(422, "failed to parse after_hash");
+  }
+  return BlockTransactionsArgs{
+      workchain.value(), shard.value(), seqno.value(), root_hash.value(), file_hash.value(), after_lt,
+      after_hash.value(), count.value_or(40), std::nullopt
+  };
+}
+
+struct TransactionsArgs {
+  std::string address;
+  std::optional<ton::LogicalTime> from_transaction_lt;
+  std::string from_transaction_hash;
+  ton::LogicalTime to_transaction_lt;
+  std::int32_t count;
+  std::int32_t chunk_size;
+  std::optional<bool> archival;
+
+  // history below a given transaction never changes, the latest one does
+  [[nodiscard]] bool is_immutable() const {
+    return from_transaction_lt.has_value() && !from_transaction_hash.empty();
+  }
+};
+
+td::Result<TransactionsArgs> parse_transactions_args(const TonlibApiRequest& request) {
+  auto address = request.GetArg("address");
+  auto limit = utils::stringToInt<std::int32_t>(request.GetArg("limit"));
+  auto count = utils::stringToInt<std::int32_t>(request.GetArg("count"));
+  auto chunk_size = utils::stringToInt<std::int32_t>(request.GetArg("chunk_size"));
+  auto from_transaction_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("lt"));
+  auto from_transaction_hash = utils::stringToHash(request.GetArg("hash"));
+  auto to_transaction_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("to_lt"));
+  auto archival = utils::stringToBool(request.GetArg("archival"));
+
+  if (address.empty()) {
+    return td::Status::Error(422, "address is required");
+  }
+  if (!from_transaction_hash.has_value()) {
+    return td::Status::Error(422, "failed to parse from_transaction_hash");
+  }
+  if (limit.has_value()) {
+    count = limit.value();
+  }
+  return TransactionsArgs{
+      std::move(address), from_transaction_lt, std::move(from_transaction_hash.value()), to_transaction_lt.value_or(0),
+      count.value_or(10), chunk_size.value_or(30), archival
+  };
+}
+
+// methods whose responses are never cached, no cache tier is looked up for them
+bool is_uncached_method(std::string_view ton_api_method) {
+  static constexpr std::array kUncachedMethods{
+      std::string_view{"sendboc"}, std::string_view{"sendbocreturnhash"}, std::string_view{"sendbocreturnhashnoerror"},
+      std::string_view{"rungetmethod"}, std::string_view{"rungetmethodbatch"},
+  };
+  return std::ranges::find(kUncachedMethods, ton_api_method) != kUncachedMethods.end();
+}
+
+// false for requests that are never answered with an immutable response, the disk cache is not looked up for them
+bool can_be_immutable(const TonlibApiRequest& request) {
+  if (request.ton_api_method == "gettransactions" || request.ton_api_method == "gettransactionsv2") {
+    auto r_args = parse_transactions_args(request);
+    return r_args.is_ok() && r_args.ok().is_immutable();
+  }
+  if (request.ton_api_method == "getshards" || request.ton_api_method == "shards") {
+    return !request.GetArg("seqno").empty();
+  }
+  return true;
+}
+
+constexpr std::string_view kCborContentType = "application/cbor";
+
+// responses are json unless the client prefers cbor
+bool accepts_cbor(const userver::server::http::HttpRequest& request) {
+  return utils::prefers_cbor(request.GetHeader(userver::http::headers::kAccept));
+}
+
+// the vary header of responses negotiated by accepts_cbor and the encoding of the body
+constexpr std::string_view kVaryHeaders = "Accept, Accept-Encoding";
+
+cache::EncodedApiV2Body encode_body(std::string body, utils::ContentEncoding encoding) {
+  if (auto compressed = utils::compress(body, encoding); compressed.has_value()) {
+    return {std::move(compressed.value()), std::string{utils::content_encoding_name(encoding)}};
+  }
+  return {std::move(body), ""};
+}
+
+void set_body_headers(const userver::server::http::HttpRequest& request, bool is_cbor, const std::string& content_encoding) {
+  auto& response = request.GetHttpResponse();
+  if (is_cbor) {
+    response.SetHeader(userver::http::headers::kContentType, std::string{kCborContentType});
+  } else {
+    response.SetContentType(userver::http::content_type::kApplicationJson);
+  }
+  if (!content_encoding.empty()) {
+    response.SetHeader(userver::http::headers::kContentEncoding, content_encoding);
+  }
+}
+
+// sends a response prepared in request.GetHttpResponse() as a single chunk of the body stream
+void push_response(
+    const userver::server::http::HttpRequest& request,
+    userver::server::http::ResponseBodyStream& stream,
+    std::string body
+) {
+  const auto& response = request.GetHttpResponse();
+  stream.SetStatusCode(response.GetStatus());
+  for (const auto& name : response.GetHeaderNames()) {
+    stream.SetHeader(std::string{name}, response.GetHeader(name));
+  }
+  stream.SetEndOfHeaders();
+  stream.PushBodyChunk(std::move(body), userver::server::request::GetTaskInheritedDeadline());
+}
+
+// Writes a response whose result is built around one long json array: the items of every page go out
+// as soon as the page is serialized. The status and headers are sent with the first chunk, so a request
+// failing before it still gets a regular error response.
+class ListResponseStream {
+public:
+  // a collected body is kept uncompressed as it is sent, so that the whole response can be cached afterwards
+  ListResponseStream(
+      userver::server::http::ResponseBodyStream& stream,
+      std::string prefix,
+      utils::ContentEncoding encoding,
+      bool is_collected
+  ) :
+      stream_(stream), prefix_(std::move(prefix)), compressor_(encoding), is_collected_(is_collected) {}
+
+  [[nodiscard]] bool IsStarted() const {
+    return is_started_;
+  }
+  [[nodiscard]] std::string& Body() {
+    return body_;
+  }
+  // appends the items of a serialized json array
+  void Append(std::string_view array_json) {
+    if (array_json.size() <= 2) {
+      return;
+    }
+    AppendItems(array_json.substr(1, array_json.size() - 2));
+  }
+  // appends comma separated json values
+  void AppendItems(std::string_view items_json) {
+    Start();
+    std::string chunk;
+    chunk.reserve(items_json.size() + 1);
+    if (has_items_) {
+      chunk += ',';
+    }
+    chunk.append(items_json);
+    has_items_ = true;
+    Push(std::move(chunk));
+  }
+  void Finish(std::string suffix) {
+    Start();
+    Push(std::move(suffix), true);
+  }
+
+private:
+  void Start() {
+    if (is_started_) {
+      return;
+    }
+    is_started_ = true;
+    stream_.SetStatusCode(userver::server::http::HttpStatus::kOk);
+    stream_.SetHeader(
+        std::string{userver::http::headers::kContentType}, userver::http::content_type::kApplicationJson.ToString()
+    );
+    // cbor clients get the whole response instead
+    stream_.SetHeader(std::string{userver::http::headers::kVary}, std::string{kVaryHeaders});
+    if (auto encoding = utils::content_encoding_name(compressor_.Encoding()); !encoding.empty()) {
+      stream_.SetHeader(std::string{userver::http::headers::kContentEncoding}, std::string{encoding});
+    }
+    stream_.SetEndOfHeaders();
+    Push(std::move(prefix_));
+  }
+  void Push(std::string chunk, bool is_last = false) {
+    if (is_collected_) {
+      body_ += chunk;
+    }
+    auto compressed = compressor_.Compress(chunk, is_last);
+    if (!compressed.empty()) {
+      stream_.PushBodyChunk(std::move(compressed), userver::server::request::GetTaskInheritedDeadline());
+    }
+  }
+
+  userver::server::http::ResponseBodyStream& stream_;
+  std::string prefix_;
+  utils::StreamCompressor compressor_;
+  bool is_collected_;
+  std::string body_;
+  bool is_started_{false};
+  bool has_items_{false};
+};
+
+// one element of a rungetmethodbatch result, in the shape of a runGetMethod response
+std::string batch_item_json(const core::TonlibWorkerResponse& res) {
+  return td::json_encode<std::string>(td::json_object([&](auto& jo) {
+    jo("ok", td::JsonBool(res.is_ok));
+    if (res.is_ok) {
+      jo("result", td::JsonRaw(res.result_str.value()));
+    } else {
+      jo("error", td::JsonString(res.error->message()));
+      if (auto code = res.error->code(); code) {
+        jo("code", code);
+      }
+    }
+  }));
+}
+
+// closes the response envelope opened by the prefix of a streamed list
+std::string list_response_suffix(std::string result_tail, const multiclient::SessionPtr& session) {
+  if (session) {
+    result_tail += ",\"@extra\":";
+    result_tail += td::json_encode<std::string>(td::JsonString(session->to_string()));
+  }
+  result_tail += '}';
+  return result_tail;
+}
+
+// closes the envelope of a streamed list that failed after its status was sent. The items already sent are
+// kept, ok is repeated as false after them, json parsers take the last value of a duplicate key.
+std::string list_error_suffix(std::string result_end, const core::TonlibWorkerResponse& res) {
+  result_end += ",\"ok\":false,\"error\":";
+  result_end += td::json_encode<std::string>(td::JsonString(res.error->message()));
+  if (auto code = res.error->code(); code) {
+    result_end += ",\"code\":" + std::to_string(code);
+  }
+  return list_response_suffix(std::move(result_end), res.session);
+}
+}  // namespace
+
 userver::formats::json::Value ApiV2Handler::build_json_response(const core::TonlibWorkerResponse& res) const {
   userver::formats::json::ValueBuilder response;
   response["ok"] = res.is_ok;
@@ -122,6 +397,14 @@ std::string ApiV2Handler::HandleRequestThrow(
     const userver::server::http::HttpRequest& request, userver::server::request::RequestContext& context
 ) const {
   TonlibApiRequest req;
+  if (auto response = parse_request(request, req); response.has_value()) {
+    return std::move(response.value());
+  }
+  return handle_request(request, req);
+}
+std::optional<std::string> ApiV2Handler::parse_request(
+    const userver::server::http::HttpRequest& request, TonlibApiRequest& req
+) const {
   req.http_method = request.GetMethodStr();
   {
     const auto& debug_request_header = request.GetHeader("X-Debug-Request");
@@ -179,23 +462,102 @@ std::string ApiV2Handler::HandleRequestThrow(
     }
     req = std::move(jsonrpc_req);
   }
-
+  return std::nullopt;
+}
+std::optional<cache::StoredApiV2Response> ApiV2Handler::find_cached_response(
+    const TonlibApiRequest& req, std::int32_t mc_seqno
+) const {
+  if (is_uncached_method(req.ton_api_method)) {
+    return std::nullopt;
+  }
+  auto cached_response = const_cache_component_.Get(req);
+  if (!cached_response.has_value()) {
+    if (auto lookup = cache_component_.Get(req, mc_seqno); lookup.has_value()) {
+      if (lookup->refresh) {
+        refresh_cached_response(req, std::move(lookup->refresh));
+      }
+      cached_response = std::move(lookup->stored);
+    }
+  }
+  if (!cached_response.has_value() && disk_cache_component_ && can_be_immutable(req)) {
+    if (auto disk_response = disk_cache_component_->Get(req); disk_response.has_value()) {
+      auto response = userver::formats::json::FromString(disk_response.value());
+      const_cache_component_.Put(req, response, disk_response->size());
+      cached_response = cache::StoredApiV2Response{std::move(response)};
+    }
+  }
+  if (!cached_response.has_value() && redis_cache_component_) {
+    if (auto shared_response = redis_cache_component_->Get(req, mc_seqno); shared_response.has_value()) {
+      // timed entries are not copied, their remaining TTL is unknown here
+      if (shared_response->mode == core::CacheMode::Immutable) {
+        const_cache_component_.Put(req, shared_response->response, shared_response->size);
+      } else if (shared_response->mode == core::CacheMode::Head) {
+        cache_component_.Put(req, shared_response->response, std::chrono::seconds(1), std::chrono::seconds(0), mc_seqno);
+      }
+      cached_response = cache::StoredApiV2Response{std::move(shared_response->response)};
+    }
+  }
+  return cached_response;
+}
+void ApiV2Handler::store_response(
+    const TonlibApiRequest& req,
+    const core::TonlibWorkerResponse& res,
+    const userver::formats::json::Value& response,
+    const std::string& response_str,
+    std::int32_t mc_seqno
+) const {
+  if (!res.is_ok || res.cache_ttl.count() == 0) {
+    return;
+  }
+  if (res.cache_mode == core::CacheMode::Immutable) {
+    const_cache_component_.Put(req, response, response_str.size());
+    if (disk_cache_component_) {
+      disk_cache_component_->Put(req, response_str);
+    }
+  } else {
+    cache_component_.Put(
+        req, response, res.cache_ttl, res.cache_stale_ttl, mc_seqno, res.cache_mode == core::CacheMode::Head
+    );
+  }
+  if (redis_cache_component_) {
+    redis_cache_component_->Put(req, response_str, res.cache_ttl, mc_seqno, res.cache_mode);
+  }
+}
+std::string ApiV2Handler::handle_request(
+    const userver::server::http::HttpRequest& request, const TonlibApiRequest& req
+) const {
+  auto mc_seqno = tonlib_component_.GetLastConsensusBlock();
+  return handle_request(request, req, find_cached_response(req, mc_seqno), mc_seqno);
+}
+std::string ApiV2Handler::handle_request(
+    const userver::server::http::HttpRequest& request,
+    const TonlibApiRequest& req,
+    std::optional<cache::StoredApiV2Response> cached_response,
+    std::int32_t mc_seqno
+) const {
   // call method
   userver::formats::json::Value response;
-  auto cached_response = cache_component_.Get(req);
+  const bool is_cbor = accepts_cbor(request);
+  const auto encoding = utils::negotiate_content_encoding(request.GetHeader(userver::http::headers::kAcceptEncoding));
+  request.GetHttpResponse().SetHeader(userver::http::headers::kVary, std::string{kVaryHeaders});
   if (cached_response.has_value()) {
-    response = std::move(cached_response.value());
-    auto response_builder = userver::formats::json::ValueBuilder(response);
-    response_builder["@extra"] = response["@extra"].As<std::string>("") + ":c";
-    auto response_str = userver::formats::json::ToString(response_builder.ExtractValue());
-    request.GetHttpResponse().SetContentType(userver::http::content_type::kApplicationJson);
+    response = std::move(cached_response->response);
+    auto make_body = [&] {
+      auto response_builder = userver::formats::json::ValueBuilder(response);
+      response_builder["@extra"] = response["@extra"].As<std::string>("") + ":c";
+      auto value = response_builder.ExtractValue();
+      return encode_body(is_cbor ? utils::to_cbor(value) : userver::formats::json::ToString(value), encoding);
+    };
+    // hot entries are printed and compressed once per variant
+    const auto variant = std::string(is_cbor ? "cbor/" : "json/") + std::string{utils::content_encoding_name(encoding)};
+    auto body = cached_response->bodies ? cached_response->bodies->Get(variant, make_body) : make_body();
     request.GetHttpResponse().SetStatus(userver::server::http::HttpStatus::kOk);
-    return response_str;
+    set_body_headers(request, is_cbor, body.content_encoding);
+    return std::move(body.body);
   }
   auto res = HandleTonlibRequest(req);
 
   // prepare response
-  request.GetHttpResponse().SetContentType(userver::http::content_type::kApplicationJson);
   auto code = res.is_ok ? 200 : res.error->code();
   if (code == 0) { code = 500; }
   if (code == -3) { code = 500; }
@@ -203,10 +565,186 @@ std::string ApiV2Handler::HandleRequestThrow(
   response = build_json_response(res);
   auto response_str = userver::formats::json::ToString(response);
   log_request(request, req, res, response_str);
-  if (res.is_ok && res.cache_ttl > 0) {
-    cache_component_.Put(req, response);
+  store_response(req, res, response, response_str, mc_seqno);
+  auto body = encode_body(is_cbor ? utils::to_cbor(response) : std::move(response_str), encoding);
+  set_body_headers(request, is_cbor, body.content_encoding);
+  return std::move(body.body);
+}
+void ApiV2Handler::HandleStreamRequest(
+    userver::server::http::HttpRequest& request,
+    userver::server::request::RequestContext& context,
+    userver::server::http::ResponseBodyStream& response_body_stream
+) const {
+  TonlibApiRequest req;
+  auto response = parse_request(request, req);
+  if (!response.has_value()) {
+    auto mc_seqno = tonlib_component_.GetLastConsensusBlock();
+    auto cached_response = find_cached_response(req, mc_seqno);
+    if (!cached_response.has_value() && stream_list_response(request, req, mc_seqno, response_body_stream)) {
+      return;
+    }
+    if (stream_batch_response(request, req, response_body_stream)) {
+      return;
+    }
+    response = handle_request(request, req, std::move(cached_response), mc_seqno);
   }
-  return response_str;
+  push_response(request, response_body_stream, std::move(response.value()));
+}
+bool ApiV2Handler::stream_list_response(
+    const userver::server::http::HttpRequest& request,
+    const TonlibApiRequest& req,
+    std::int32_t mc_seqno,
+    userver::server::http::ResponseBodyStream& response_body_stream
+) const {
+  // smaller lists are answered in one piece and cached as usual
+  static constexpr std::int32_t kStreamedListSize = 256;
+
+  const bool is_transactions = req.ton_api_method == "gettransactions" || req.ton_api_method == "gettransactionsv2";
+  const bool is_block_transactions = req.ton_api_method == "getblocktransactionsext";
+  if (!is_transactions && !is_block_transactions) {
+    return false;
+  }
+  auto r_transactions_args = parse_transactions_args(req);
+  auto r_block_args = parse_block_transactions_args(req);
+  if (is_transactions ? (r_transactions_args.is_error() || r_transactions_args.ok().count < kStreamedListSize)
+                      : (r_block_args.is_error() || r_block_args.ok().count < kStreamedListSize)) {
+    return false;
+  }
+  // cbor is encoded from the whole json value
+  if (accepts_cbor(request)) {
+    return false;
+  }
+  // lists of a block or below a given transaction never change, they are cached like the ones answered in one piece
+  const bool is_immutable = is_block_transactions || r_transactions_args.ok().is_immutable();
+
+  const bool v2_schema = req.ton_api_method == "gettransactionsv2";
+  // the transactions are wrapped into a result object, except for the plain list of gettransactions
+  const bool is_result_object = is_block_transactions || v2_schema;
+  std::string prefix = R"({"ok":true,"result":)";
+  if (is_block_transactions) {
+    prefix += R"({"@type":"blocks.transactionsExt","transactions":[)";
+  } else if (v2_schema) {
+    prefix += R"({"@type":"raw.transactions","transactions":[)";
+  } else {
+    prefix += '[';
+  }
+  const auto encoding = utils::negotiate_content_encoding(request.GetHeader(userver::http::headers::kAcceptEncoding));
+  ListResponseStream writer(response_body_stream, std::move(prefix), encoding, is_immutable);
+  core::TonlibWorker::TransactionPageCallback on_page = [&](core::TonlibWorker::TransactionPage&& page) {
+    writer.Append(
+        is_block_transactions
+            ? tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::serialize_block_transactions_page, page)
+            : tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::serialize_transactions_page, page)
+    );
+  };
+
+  // the rest of the result goes after the array, its fields are known once the last page is fetched
+  td::Result<std::string> r_result_tail;
+  multiclient::SessionPtr session;
+  if (is_block_transactions) {
+    const auto& args = r_block_args.ok();
+    auto [res, new_session] = tonlib_component_.DoRequest(&core::TonlibWorker::streamBlockTransactionsExt,
+      args.workchain, args.shard, args.seqno, args.count, args.root_hash, args.file_hash, args.after_lt, args.after_hash, args.archival, on_page, nullptr);
+    session = std::move(new_session);
+    if (res.is_error()) {
+      r_result_tail = res.move_as_error();
+    } else {
+      const auto& txs = res.ok();
+      r_result_tail = "],\"id\":" + td::json_encode<std::string>(td::ToJson(txs->id_)) +
+                      ",\"req_count\":" + std::to_string(txs->req_count_) +
+                      ",\"incomplete\":" + (txs->incomplete_ ? "true" : "false") + "}";
+    }
+  } else {
+    const auto& args = r_transactions_args.ok();
+    bool try_decode_messages = true;
+    auto [res, new_session] = tonlib_component_.DoRequest(&core::TonlibWorker::streamTransactions,
+      args.address, args.from_transaction_lt, args.from_transaction_hash, args.to_transaction_lt, args.count,
+      args.chunk_size, try_decode_messages, args.archival, on_page, nullptr);
+    session = std::move(new_session);
+    if (res.is_error()) {
+      r_result_tail = res.move_as_error();
+    } else if (!v2_schema) {
+      r_result_tail = std::string("]");
+    } else {
+      std::string result_tail = "]";
+      if (const auto& previous = res.ok()->previous_transaction_id_; previous) {
+        result_tail += ",\"previous_transaction_id\":" + td::json_encode<std::string>(td::ToJson(previous));
+      }
+      r_result_tail = result_tail + "}";
+    }
+  }
+
+  if (r_result_tail.is_ok()) {
+    writer.Finish(list_response_suffix(r_result_tail.move_as_ok(), session));
+    auto res = core::TonlibWorkerResponse{true, nullptr, std::nullopt, std::nullopt, session}.Cachable().Immutable(
+        is_immutable
+    );
+    log_request(request, req, res, "");
+    if (is_immutable) {
+      store_response(req, res, userver::formats::json::FromString(writer.Body()), writer.Body(), mc_seqno);
+    }
+    return true;
+  }
+  auto res = core::TonlibWorkerResponse{false, nullptr, std::nullopt, r_result_tail.move_as_error(), session};
+  if (writer.IsStarted()) {
+    writer.Finish(list_error_suffix(is_result_object ? "]}" : "]", res));
+    log_request(request, req, res, "");
+    return true;
+  }
+  push_stream_error(request, req, res, response_body_stream);
+  return true;
+}
+bool ApiV2Handler::stream_batch_response(
+    const userver::server::http::HttpRequest& request,
+    const TonlibApiRequest& req,
+    userver::server::http::ResponseBodyStream& response_body_stream
+) const {
+  if (req.ton_api_method != "rungetmethodbatch" || accepts_cbor(request)) {
+    return false;
+  }
+  auto r_args = parse_run_get_method_batch_args(req);
+  if (r_args.is_error()) {
+    return false;
+  }
+  const auto args = r_args.move_as_ok();
+
+  const auto encoding = utils::negotiate_content_encoding(request.GetHeader(userver::http::headers::kAcceptEncoding));
+  ListResponseStream writer(response_body_stream, R"({"ok":true,"result":[)", encoding, false);
+  core::TonlibWorker::RunGetMethodResultCallback on_result = [&](td::Result<core::RunGetMethodResult>&& result) {
+    writer.AppendItems(batch_item_json(
+        tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_runGetMethod, std::move(result), nullptr)
+    ));
+  };
+  auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::streamRunGetMethodBatch,
+    args.entries, args.seqno, args.archival, on_result, nullptr);
+  if (res.is_ok()) {
+    writer.Finish(list_response_suffix("]", session));
+    log_request(request, req, core::TonlibWorkerResponse{true, nullptr, std::nullopt, std::nullopt, session}, "");
+    return true;
+  }
+  auto error = core::TonlibWorkerResponse{false, nullptr, std::nullopt, res.move_as_error(), session};
+  if (writer.IsStarted()) {
+    writer.Finish(list_error_suffix("]", error));
+    log_request(request, req, error, "");
+    return true;
+  }
+  push_stream_error(request, req, error, response_body_stream);
+  return true;
+}
+void ApiV2Handler::push_stream_error(
+    const userver::server::http::HttpRequest& request,
+    const TonlibApiRequest& req,
+    const core::TonlibWorkerResponse& res,
+    userver::server::http::ResponseBodyStream& response_body_stream
+) const {
+  auto code = res.error->code();
+  if (code == 0) { code = 500; }
+  if (code == -3) { code = 500; }
+  request.GetHttpResponse().SetContentType(userver::http::content_type::kApplicationJson);
+  request.GetHttpResponse().SetStatus(static_cast<userver::server::http::HttpStatus>(code));
+  auto response_str = userver::formats::json::ToString(build_json_response(res));
+  log_request(request, req, res, response_str);
+  push_response(request, response_body_stream, std::move(response_str));
 }
 ApiV2Handler::ApiV2Handler(
     const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context
@@ -214,9 +752,64 @@ ApiV2Handler::ApiV2Handler(
   HttpHandlerBase(config, context),
   tonlib_component_(context.FindComponent<core::TonlibComponent>()),
   cache_component_(context.FindComponent<cache::CacheApiV2Component>()),
-  logger_(context.FindComponent<userver::components::Logging>().GetLogger("api-v2")) {
+  const_cache_component_(context.FindComponent<cache::ConstCacheApiV2Component>()),
+  disk_cache_component_(context.FindComponentOptional<cache::DiskCacheApiV2Component>()),
+  redis_cache_component_(context.FindComponentOptional<cache::RedisCacheApiV2Component>()),
+  logger_(context.FindComponent<userver::components::Logging>().GetLogger("api-v2")),
+  refresh_tasks_(tonlib_component_.GetTaskProcessor()) {
+}
+void ApiV2Handler::refresh_cached_response(const TonlibApiRequest& req, std::shared_ptr<std::atomic<bool>> refresh) const {
+  refresh_tasks_.AsyncDetach("cache_refresh", [this, req, refresh = std::move(refresh)] {
+    auto mc_seqno = tonlib_component_.GetLastConsensusBlock();
+    auto res = HandleTonlibRequest(req);
+    if (!res.is_ok || res.cache_ttl.count() == 0 || res.cache_mode == core::CacheMode::Immutable) {
+      // let the next hit on the stale entry try again
+      refresh->store(false);
+      return;
+    }
+    cache_component_.Put(
+        req, build_json_response(res), res.cache_ttl, res.cache_stale_ttl, mc_seqno,
+        res.cache_mode == core::CacheMode::Head
+    );
+  });
+}
+td::Result<ApiV2Handler::RunGetMethodBatchArgs> ApiV2Handler::parse_run_get_method_batch_args(
+    const TonlibApiRequest& request
+) const {
+  static constexpr std::size_t kMaxBatchSize = 256;
+
+  const auto& requests = request.GetArgVector("requests");
+  if (requests.empty()) {
+    return td::Status::Error(422, "requests are required");
+  }
+  if (requests.size() > kMaxBatchSize) {
+    return td::Status::Error(422, "too many requests, at most " + std::to_string(kMaxBatchSize) + " allowed");
+  }
+  RunGetMethodBatchArgs args;
+  args.entries.reserve(requests.size());
+  try {
+    for (const auto& item : requests) {
+      auto value = userver::formats::json::FromString(item);
+      core::RunGetMethodBatchEntry entry{
+          .address = value["address"].As<std::string>(),
+          .method = parse_request_body_item(value["method"]).at(0),
+          .stack = value.HasMember("stack") ? parse_request_body_item(value["stack"], 1) : std::vector<std::string>{},
+      };
+      args.entries.push_back(std::move(entry));
+    }
+  } catch (const std::exception& e) {
+    return td::Status::Error(422, std::string("failed to parse requests: ") + e.what());
+  }
+  args.seqno = utils::stringToInt<ton::BlockSeqno>(request.GetArg("seqno"));
+  args.archival = utils::stringToBool(request.GetArg("archival"));
+  return args;
 }
 core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequest& request) const {
+  // blockchain config changes by voting, so it is not worth refetching on every block
+  static constexpr auto kConfigCacheTtl = std::chrono::minutes(1);
+  // hot head-state keys are served this much past expiry while being refreshed
+  static constexpr auto kHeadStaleTtl = std::chrono::seconds(1);
+
   std::string ton_api_method;
   std::ranges::copy(std::views::transform(request.ton_api_method, ::tolower), std::back_inserter(ton_api_method));
 
@@ -228,7 +821,8 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getAddressInformation, address, seqno, nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressInformation, address, std::move(res), std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressInformation, address, std::move(res), std::move(session))
+      .Cachable().StaleWhileRevalidate(kHeadStaleTtl).Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getextendedaddressinformation") {
@@ -239,7 +833,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getExtendedAddressInformation, address, seqno, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getwalletinformation") {
@@ -249,7 +843,8 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string("address is required", 422, nullptr);
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getAddressInformation, address, seqno, nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getWalletInformation, address, std::move(res), std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getWalletInformation, address, std::move(res), std::move(session))
+      .Cachable().StaleWhileRevalidate(kHeadStaleTtl).Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getaddressbalance") {
@@ -259,7 +854,8 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string("address is required", 422, nullptr);
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getAddressInformation, address, seqno, nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressBalance, address, std::move(res), std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressBalance, address, std::move(res), std::move(session))
+      .Cachable().StaleWhileRevalidate(kHeadStaleTtl).Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getaddressstate") {
@@ -269,7 +865,8 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string("address is required", 422, nullptr);
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getAddressInformation, address, seqno, nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressState, address, std::move(res), std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getAddressState, address, std::move(res), std::move(session))
+      .Cachable().StaleWhileRevalidate(kHeadStaleTtl).Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "detectaddress") {
@@ -283,7 +880,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string(error.to_string(), error.code(), std::move(session));
     }
     auto res_str = res.move_as_ok().to_json_string();
-    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "gettokendata") {
@@ -303,7 +900,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string(error.to_string(), error.code(), std::move(session));
     }
     auto res_str = res.move_as_ok()->to_json_string();
-    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "detecthash") {
@@ -317,12 +914,13 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string(error.to_string(), error.code(), std::move(session));
     }
     auto res_str = res.move_as_ok().to_json_string();
-    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "getmasterchaininfo") {
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getMasterchainInfo, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session))
+      .Cachable(std::chrono::milliseconds(500)).StaleWhileRevalidate(kHeadStaleTtl);
   }
   if (ton_api_method == "getconsensusblock") {
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getConsensusBlock, nullptr);
@@ -331,7 +929,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string(error.to_string(), error.code(), std::move(session));
     }
     auto res_str = res.move_as_ok().to_json_string();
-    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res_str, std::move(session)).Cachable().StaleWhileRevalidate(kHeadStaleTtl);
   }
 
   if (ton_api_method == "getmasterchainblocksignatures") {
@@ -340,7 +938,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string("seqno is required", 422, nullptr);
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getMasterchainBlockSignatures, seqno.value(), nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "getshardblockproof") {
@@ -360,7 +958,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getShardBlockProof,
       workchain.value(), shard.value(), seqno.value(), from_seqno, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable(from_seqno.has_value());
   }
 
   if (ton_api_method == "lookupblock") {
@@ -378,7 +976,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::lookupBlock,
       workchain.value(), shard.value(), seqno, lt, unixtime, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getshards" || ton_api_method == "shards") {
@@ -387,7 +985,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     auto unixtime = utils::stringToInt<ton::UnixTime>(request.GetArg("unixtime"));
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getShards, seqno, lt, unixtime, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getblockheader") {
@@ -414,7 +1012,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getBlockHeader,
       workchain.value(), shard.value(), seqno.value(), root_hash.value(), file_hash.value(), nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "getoutmsgqueuesizes") {
@@ -437,98 +1035,48 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::lookupBlock,
       workchain.value(), shard.value(), seqno, lt, unixtime, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getblocktransactions" || ton_api_method == "getblocktransactionsext") {
-    auto workchain = utils::stringToInt<ton::WorkchainId>(request.GetArg("workchain"));
-    auto shard = utils::stringToInt<ton::ShardId>(request.GetArg("shard"));
-    auto seqno = utils::stringToInt<ton::BlockSeqno>(request.GetArg("seqno"));
-    auto root_hash = utils::stringToHash(request.GetArg("root_hash"));
-    auto file_hash = utils::stringToHash(request.GetArg("file_hash"));
-    auto after_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("after_lt"));
-    auto after_hash = utils::stringToHash(request.GetArg("after_hash"));
-    auto count = utils::stringToInt<std::int32_t>(request.GetArg("count"));
-
-    if (!workchain.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("workchain is required", 422, nullptr);
-    }
-    if (!shard.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("shard is required", 422, nullptr);
-    }
-    if (!seqno.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("seqno is required", 422, nullptr);
-    }
-    if (!root_hash.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("failed to parse root_hash", 422, nullptr);
-    }
-    if (!file_hash.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("failed to parse file_hash", 422, nullptr);
-    }
-    if (!after_hash.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("failed to parse after_hash", 422, nullptr);
+    auto r_args = parse_block_transactions_args(request);
+    if (r_args.is_error()) {
+      return core::TonlibWorkerResponse::from_error_string(r_args.error().message().str(), r_args.error().code(), nullptr);
     }
-    if (!count.has_value()) {
-      count = 40;
-    }
-    std::optional<bool> archival = std::nullopt;
+    const auto args = r_args.move_as_ok();
     if (ton_api_method == "getblocktransactions") {
       auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getBlockTransactions,
-      workchain.value(), shard.value(), seqno.value(), count.value(), root_hash.value(), file_hash.value(), after_lt, after_hash.value(), archival, nullptr);
+      args.workchain, args.shard, args.seqno, args.count, args.root_hash, args.file_hash, args.after_lt, args.after_hash, args.archival, nullptr);
 
-      return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getBlockTransactions, std::move(res), std::move(session));
+      return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getBlockTransactions, std::move(res), std::move(session)).Cachable().Immutable();
     } else if (ton_api_method == "getblocktransactionsext") {
       auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getBlockTransactionsExt,
-      workchain.value(), shard.value(), seqno.value(), count.value(), root_hash.value(), file_hash.value(), after_lt, after_hash.value(), archival, nullptr);
+      args.workchain, args.shard, args.seqno, args.count, args.root_hash, args.file_hash, args.after_lt, args.after_hash, args.archival, nullptr);
 
-      return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getBlockTransactionsExt, std::move(res), std::move(session)).Cachable();
+      return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getBlockTransactionsExt, std::move(res), std::move(session)).Cachable().Immutable();
     }
   }
 
   if (ton_api_method == "gettransactions" || ton_api_method == "gettransactionsv2") {
-    auto address = request.GetArg("address");
-    auto limit = utils::stringToInt<std::int32_t>(request.GetArg("limit"));
-    auto count = utils::stringToInt<std::int32_t>(request.GetArg("count"));
-    auto chunk_size = utils::stringToInt<std::int32_t>(request.GetArg("chunk_size"));
-    auto from_transaction_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("lt"));
-    auto from_transaction_hash = utils::stringToHash(request.GetArg("hash"));
-    auto to_transaction_lt = utils::stringToInt<ton::LogicalTime>(request.GetArg("to_lt"));
-    auto archival = utils::stringToBool(request.GetArg("archival"));
-    bool try_decode_messages = true;
-
-    if (address.empty()) {
-      return core::TonlibWorkerResponse::from_error_string("address is required", 422, nullptr);
-    }
-    if (!from_transaction_hash.has_value()) {
-      return core::TonlibWorkerResponse::from_error_string("failed to parse from_transaction_hash", 422, nullptr);
-    }
-
-
-    if (limit.has_value()) {
-      count = limit.value();
-    }
-    if (!count.has_value()) {
-      count = 10;
-    }
-    if (!to_transaction_lt.has_value()) {
-      to_transaction_lt = 0;
-    }
-    if (!chunk_size.has_value()) {
-      chunk_size = 30;
+    auto r_args = parse_transactions_args(request);
+    if (r_args.is_error()) {
+      return core::TonlibWorkerResponse::from_error_string(r_args.error().message().str(), r_args.error().code(), nullptr);
     }
+    const auto args = r_args.move_as_ok();
+    bool try_decode_messages = true;
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getTransactions,
-      address,
-      from_transaction_lt,
-      from_transaction_hash.value(),
-      to_transaction_lt.value(),
-      count.value(),
-      chunk_size.value(),
+      args.address,
+      args.from_transaction_lt,
+      args.from_transaction_hash,
+      args.to_transaction_lt,
+      args.count,
+      args.chunk_size,
       try_decode_messages,
-      archival,
+      args.archival,
       nullptr
     );
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), ton_api_method == "gettransactionsv2", false, std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), ton_api_method == "gettransactionsv2", false, std::move(session)).Cachable().Immutable(args.is_immutable());
   }
 
   if (ton_api_method == "trylocatetx" || ton_api_method == "trylocateresulttx") {
@@ -547,7 +1095,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::tryLocateTransactionByIncomingMessage, source, destination, created_lt.value(), nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), false, true, std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), false, true, std::move(session)).Cachable().Immutable();
   }
   if (ton_api_method == "trylocatesourcetx") {
     auto source = request.GetArg("source");
@@ -565,7 +1113,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
 
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::tryLocateTransactionByOutgoingMessage, source, destination, created_lt.value(), nullptr);
-    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), false, true, std::move(session)).Cachable();
+    return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_getTransactions, std::move(res), false, true, std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "getconfigparam") {
@@ -575,12 +1123,14 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       return core::TonlibWorkerResponse::from_error_string("config_id is required", 422, nullptr);
     }
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getConfigParam, config_id.value(), seqno, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session))
+      .Cachable(kConfigCacheTtl).StaleWhileRevalidate(kConfigCacheTtl).Timed().Immutable(seqno.has_value());
   }
   if (ton_api_method == "getconfigall") {
     auto seqno = utils::stringToInt<ton::BlockSeqno>(request.GetArg("seqno"));
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getConfigAll, seqno, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session))
+      .Cachable(kConfigCacheTtl).StaleWhileRevalidate(kConfigCacheTtl).Timed().Immutable(seqno.has_value());
   }
 
   if (ton_api_method == "getlibraries") {
@@ -597,7 +1147,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     }
     // LOG_ERROR_TO(*logger_) << "getlibraries: " << libs;
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::getLibraries, libs, nullptr);
-    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "sendboc") {
@@ -640,6 +1190,32 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
     return tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_runGetMethod, std::move(res), std::move(session));
   }
 
+  if (ton_api_method == "rungetmethodbatch") {
+    auto r_args = parse_run_get_method_batch_args(request);
+    if (r_args.is_error()) {
+      return core::TonlibWorkerResponse::from_error_string(r_args.error().message().str(), r_args.error().code(), nullptr);
+    }
+    const auto args = r_args.move_as_ok();
+
+    auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::runGetMethodBatch,
+      args.entries, args.seqno, args.archival, nullptr);
+    if (res.is_error()) {
+      auto error = res.move_as_error();
+      return core::TonlibWorkerResponse::from_error_string(error.message().str(), error.code(), std::move(session));
+    }
+    std::string results = "[";
+    for (auto& result : res.move_as_ok()) {
+      if (results.size() > 1) {
+        results += ',';
+      }
+      results += batch_item_json(
+          tonlib_component_.DoPostprocess(&core::TonlibPostProcessor::process_runGetMethod, std::move(result), nullptr)
+      );
+    }
+    results += ']';
+    return core::TonlibWorkerResponse::from_result_string(results, std::move(session));
+  }
+
   if (ton_api_method == "unpackaddress") {
     auto address = request.GetArg("address");
     auto [res, session] = tonlib_component_.DoRequest(&core::TonlibWorker::unpackAddress, address, nullptr);
@@ -647,7 +1223,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       auto error = res.move_as_error();
       return core::TonlibWorkerResponse::from_error_string(error.message().str(), error.code(), std::move(session));
     }
-    return core::TonlibWorkerResponse::from_result_string(res.move_as_ok(), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res.move_as_ok(), std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "packaddress") {
@@ -657,7 +1233,7 @@ core::TonlibWorkerResponse ApiV2Handler::HandleTonlibRequest(const TonlibApiRequ
       auto error = res.move_as_error();
       return core::TonlibWorkerResponse::from_error_string(error.message().str(), error.code(), std::move(session));
     }
-    return core::TonlibWorkerResponse::from_result_string(res.move_as_ok(), std::move(session)).Cachable();
+    return core::TonlibWorkerResponse::from_result_string(res.move_as_ok(), std::move(session)).Cachable().Immutable();
   }
 
   if (ton_api_method == "estimatefee") {
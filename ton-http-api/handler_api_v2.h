@@ -2,7 +2,9 @@
 #include "request.hpp"
 #include "cache.hpp"
 #include "tonlib_component.h"
+#include "userver/concurrent/background_task_storage.hpp"
 #include "userver/server/handlers/http_handler_base.hpp"
+#include "userver/server/http/http_response_body_stream.hpp"
 
 namespace ton_http::handlers {
 class ApiV2Handler final : public userver::server::handlers::HttpHandlerBase {
@@ -10,15 +12,73 @@ public:
   static constexpr std::string_view kName = "handler-api-v2";
   using HttpHandlerBase::HttpHandlerBase;
   std::string HandleRequestThrow(const userver::server::http::HttpRequest& request, userver::server::request::RequestContext& context) const override;
+  // large transaction lists are streamed page by page and get method batches result by result,
+  // everything else is answered by HandleRequestThrow
+  void HandleStreamRequest(
+      userver::server::http::HttpRequest& request,
+      userver::server::request::RequestContext& context,
+      userver::server::http::ResponseBodyStream& response_body_stream
+  ) const override;
   ApiV2Handler(const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context);
 private:
   core::TonlibComponent& tonlib_component_;
   cache::CacheApiV2Component& cache_component_;
+  cache::ConstCacheApiV2Component& const_cache_component_;
+  cache::DiskCacheApiV2Component* disk_cache_component_;
+  cache::RedisCacheApiV2Component* redis_cache_component_;
   userver::logging::LoggerPtr logger_;
+  // must be the last member, refresh tasks use the ones above
+  mutable userver::concurrent::BackgroundTaskStorage refresh_tasks_;
+  // fills `req`, a response is returned for requests answered without tonlib
+  [[nodiscard]] std::optional<std::string> parse_request(const userver::server::http::HttpRequest& request, TonlibApiRequest& req) const;
+  [[nodiscard]] std::string handle_request(const userver::server::http::HttpRequest& request, const TonlibApiRequest& req) const;
+  // answers from `cached_response` if it is found, from tonlib otherwise
+  [[nodiscard]] std::string handle_request(
+      const userver::server::http::HttpRequest& request,
+      const TonlibApiRequest& req,
+      std::optional<cache::StoredApiV2Response> cached_response,
+      std::int32_t mc_seqno
+  ) const;
+  [[nodiscard]] std::optional<cache::StoredApiV2Response> find_cached_response(const TonlibApiRequest& req, std::int32_t mc_seqno) const;
+  // writes a successful response to every cache tier it belongs in
+  void store_response(
+      const TonlibApiRequest& req,
+      const core::TonlibWorkerResponse& res,
+      const userver::formats::json::Value& response,
+      const std::string& response_str,
+      std::int32_t mc_seqno
+  ) const;
+  // streams large transaction lists that are not cached, returns false for requests that are answered in one piece
+  bool stream_list_response(
+      const userver::server::http::HttpRequest& request,
+      const TonlibApiRequest& req,
+      std::int32_t mc_seqno,
+      userver::server::http::ResponseBodyStream& response_body_stream
+  ) const;
+  // streams rungetmethodbatch results in request order as they complete, returns false for other requests
+  bool stream_batch_response(
+      const userver::server::http::HttpRequest& request,
+      const TonlibApiRequest& req,
+      userver::server::http::ResponseBodyStream& response_body_stream
+  ) const;
+  // answers a streamed request that failed before its response was started
+  void push_stream_error(
+      const userver::server::http::HttpRequest& request,
+      const TonlibApiRequest& req,
+      const core::TonlibWorkerResponse& res,
+      userver::server::http::ResponseBodyStream& response_body_stream
+  ) const;
+  struct RunGetMethodBatchArgs {
+    std::vector<core::RunGetMethodBatchEntry> entries;
+    std::optional<ton::BlockSeqno> seqno;
+    std::optional<bool> archival;
+  };
+  [[nodiscard]] td::Result<RunGetMethodBatchArgs> parse_run_get_method_batch_args(const TonlibApiRequest& request) const;
   [[nodiscard]] core::TonlibWorkerResponse HandleTonlibRequest(const TonlibApiRequest& request) const;
   [[nodiscard]] bool is_log_required(const TonlibApiRequest& request, const core::TonlibWorkerResponse& response) const;
   [[nodiscard]] userver::formats::json::Value build_json_response(const core::TonlibWorkerResponse& res) const;
   [[nodiscard]] std::vector<std::string> parse_request_body_item(const userver::formats::json::Value& value, int parse_array_depth=0) const;
+  void refresh_cached_response(const TonlibApiRequest& req, std::shared_ptr<std::atomic<bool>> refresh) const;
   void log_request(
       const userver::server::http::HttpRequest& request,
       const TonlibApiRequest& req,
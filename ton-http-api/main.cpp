@@ -5,6 +5,10 @@
 #include "userver/utils/daemon_run.hpp"
 #include "userver/clients/http/component.hpp"
 #include "userver/clients/dns/component.hpp"
+#include "userver/storages/redis/component.hpp"
+#include "userver/storages/secdist/component.hpp"
+#include "userver/storages/secdist/provider_component.hpp"
+#include "userver/testsuite/testsuite_support.hpp"
 
 #include "td/utils/port/signals.h"
 
@@ -24,5 +28,13 @@ int main(int argc, char* argv[]) {
   component_list.Append<ton_http::core::TonlibComponent>();
   component_list.Append<ton_http::handlers::ApiV2Handler>();
   component_list.Append<ton_http::cache::CacheApiV2Component>();
+  component_list.Append<ton_http::cache::ConstCacheApiV2Component>();
+  component_list.Append<ton_http::cache::DiskCacheApiV2Component>();
+  // shared cache tier, disabled unless redis_cache_enabled is set in config vars
+  component_list.Append<userver::components::Secdist>();
+  component_list.Append<userver::components::DefaultSecdistProvider>();
+  component_list.Append<userver::components::TestsuiteSupport>();
+  component_list.Append<userver::components::Redis>("redis");
+  component_list.Append<ton_http::cache::RedisCacheApiV2Component>();
   return userver::utils::DaemonMain(argc, argv, component_list);
 }
@@ -0,0 +1,95 @@
+#include "message_index.h"
+
+#include <mutex>
+#include <vector>
+
+namespace ton_http::core {
+
+std::string MessageIndex::MakeKey(
+    const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+) {
+  std::string key;
+  key.reserve(2 * (sizeof(ton::WorkchainId) + 32) + sizeof(ton::LogicalTime));
+  key.append(reinterpret_cast<const char*>(&source.workchain), sizeof(source.workchain));
+  key.append(source.addr.as_slice().str());
+  key.append(reinterpret_cast<const char*>(&destination.workchain), sizeof(destination.workchain));
+  key.append(destination.addr.as_slice().str());
+  key.append(reinterpret_cast<const char*>(&created_lt), sizeof(created_lt));
+  return key;
+}
+
+void MessageIndex::Remember(const tonlib_api::raw_transaction& tx) {
+  if (!tx.address_ || !tx.transaction_id_) {
+    return;
+  }
+  auto r_account = block::StdAddress::parse(tx.address_->account_address_);
+  if (r_account.is_error()) {
+    return;
+  }
+  auto account = r_account.move_as_ok();
+  const Location location{tx.address_->account_address_, {tx.transaction_id_->lt_, tx.transaction_id_->hash_}};
+
+  // keys are built before taking the lock, parsing addresses is the expensive part
+  std::optional<std::string> in_key;
+  if (tx.in_msg_ && tx.in_msg_->source_ && !tx.in_msg_->source_->account_address_.empty()) {
+    auto r_source = block::StdAddress::parse(tx.in_msg_->source_->account_address_);
+    if (r_source.is_ok()) {
+      in_key = MakeKey(r_source.ok(), account, tx.in_msg_->created_lt_);
+    }
+  }
+  std::vector<std::string> out_keys;
+  for (const auto& out_msg : tx.out_msgs_) {
+    if (!out_msg || !out_msg->destination_ || out_msg->destination_->account_address_.empty()) {
+      continue;
+    }
+    auto r_destination = block::StdAddress::parse(out_msg->destination_->account_address_);
+    if (r_destination.is_ok()) {
+      out_keys.push_back(MakeKey(account, r_destination.ok(), out_msg->created_lt_));
+    }
+  }
+
+  std::lock_guard lock(mutex_);
+  if (in_key.has_value()) {
+    Insert(std::move(in_key.value())).destination = location;
+  }
+  for (auto& key : out_keys) {
+    Insert(std::move(key)).source = location;
+  }
+  while (messages_.size() > capacity_) {
+    messages_.erase(order_.front());
+    order_.pop_front();
+  }
+}
+
+std::optional<MessageIndex::Location> MessageIndex::FindDestination(
+    const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+) {
+  auto key = MakeKey(source, destination, created_lt);
+  std::lock_guard lock(mutex_);
+  auto it = messages_.find(key);
+  if (it == messages_.end()) {
+    return std::nullopt;
+  }
+  return it->second.destination;
+}
+
+std::optional<MessageIndex::Location> MessageIndex::FindSource(
+    const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+) {
+  auto key = MakeKey(source, destination, created_lt);
+  std::lock_guard lock(mutex_);
+  auto it = messages_.find(key);
+  if (it == messages_.end()) {
+    return std::nullopt;
+  }
+  return it->second.source;
+}
+
+MessageIndex::Message& MessageIndex::Insert(std::string key) {
+  auto [it, is_new] = messages_.try_emplace(key);
+  if (is_new) {
+    order_.push_back(std::move(key));
+  }
+  return it->second;
+}
+}  // namespace ton_http::core
@@ -0,0 +1,54 @@
+#pragma once
+#include <deque>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "auto/tl/tonlib_api.h"
+#include "block/block.h"
+#include "ton/ton-types.h"
+#include "transaction_chain_index.h"
+#include "userver/engine/mutex.hpp"
+
+namespace ton_http::core {
+
+// Rolling index of recent internal messages: (source, destination, created_lt) -> transactions that sent
+// and received the message. It is filled from new blocks and lets the tryLocate* lookups skip the block scan.
+// Messages are dropped in insertion order once their number exceeds the capacity.
+class MessageIndex {
+public:
+  struct Location {
+    std::string account;
+    TransactionId transaction_id;
+  };
+
+  explicit MessageIndex(std::size_t capacity) : capacity_(capacity) {}
+
+  // records in_msg and out_msgs of a transaction from a block
+  void Remember(const tonlib_api::raw_transaction& tx);
+  // transaction of the destination that received the message
+  std::optional<Location> FindDestination(
+      const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+  );
+  // transaction of the source that sent the message
+  std::optional<Location> FindSource(
+      const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+  );
+
+private:
+  struct Message {
+    std::optional<Location> source;
+    std::optional<Location> destination;
+  };
+
+  static std::string MakeKey(
+      const block::StdAddress& source, const block::StdAddress& destination, ton::LogicalTime created_lt
+  );
+  Message& Insert(std::string key);
+
+  const std::size_t capacity_;
+  userver::engine::Mutex mutex_;
+  std::unordered_map<std::string, Message> messages_;
+  std::deque<std::string> order_;
+};
+}  // namespace ton_http::core
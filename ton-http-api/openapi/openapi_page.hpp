@@ -2090,6 +2090,52 @@ std::string GetOpenApiJson() {
         ]
       }
     },
+    "/api/v2/runGetMethodBatch": {
+      "post": {
+        "tags": [
+          "run method"
+        ],
+        "summary": "Run Get Method Batch",
+        "description": "Run several get methods at the same masterchain block. Results are returned in the order of requests, each one in the format of `runGetMethod` response.",
+        "operationId": "run_get_method_batch_runGetMethodBatch_post",
+        "requestBody": {
+          "content": {
+            "application/json": {
+              "schema": {
+                "$ref": "#/components/schemas/Body_run_get_method_batch_runGetMethodBatch_post"
+              }
+            }
+          },
+          "required": true
+        },
+        "responses": {
+          "200": {
+            "description": "Successful Response",
+            "content": {
+              "application/json": {
+                "schema": {
+                  "$ref": "#/components/schemas/TonResponse"
+                }
+              }
+            }
+          },
+          "422": {
+            "description": "Validation Error"
+          },
+          "504": {
+            "description": "Lite Server Timeout"
+          }
+        },
+        "security": [
+          {
+            "APIKeyHeader": []
+          },
+          {
+            "APIKeyQuery": []
+          }
+        ]
+      }
+    },
     "/api/v2/jsonRPC": {
       "post": {
         "tags": [
@@ -2221,6 +2267,29 @@ std::string GetOpenApiJson() {
         ],
         "title": "Body_run_get_method_runGetMethod_post"
       },
+      "Body_run_get_method_batch_runGetMethodBatch_post": {
+        "properties": {
+          "requests": {
+            "items": {
+              "$ref": "#/components/schemas/Body_run_get_method_runGetMethod_post"
+            },
+            "type": "array",
+            "maxItems": 256,
+            "title": "Requests",
+            "description": "Get method calls, `seqno` of an item is ignored"
+          },
+          "seqno": {
+            "type": "integer",
+            "title": "Seqno",
+            "description": "Seqno of masterchain block at which moment all Get Methods are to be executed, the latest block if omitted"
+          }
+        },
+        "type": "object",
+        "required": [
+          "requests"
+        ],
+        "title": "Body_run_get_method_batch_runGetMethodBatch_post"
+      },
       "Body_send_boc_return_hash_sendBocReturnHash_post": {
         "properties": {
           "boc": {
@@ -34,6 +34,29 @@ struct TonlibApiRequest {
   void SetArgVector(const std::string& name, const std::vector<std::string>& values) {
     args.insert_or_assign(name, values);
   }
+  // every part is length-prefixed, so the arguments of one request can't spell out the key of another;
+  // values are sorted the same way operator== compares them
+  [[nodiscard]] std::string ToCacheKey() const {
+    std::string key;
+    const auto append = [&key](std::string_view part) {
+      key += std::to_string(part.size());
+      key += ':';
+      key += part;
+    };
+    append(http_method);
+    append(ton_api_method);
+    for (auto& [k, v] : args) {
+      append(k);
+      key += std::to_string(v.size());
+      key += '#';
+      auto values = v;
+      std::ranges::sort(values);
+      for (auto& i : values) {
+        append(i);
+      }
+    }
+    return key;
+  }
 
   friend bool operator==(const TonlibApiRequest& a, const TonlibApiRequest& b) {
     if (!(a.http_method == b.http_method && a.ton_api_method == b.ton_api_method)) {
@@ -60,21 +83,7 @@ namespace std {
 template<>
 struct hash<ton_http::handlers::TonlibApiRequest> {
   std::size_t operator()(const ton_http::handlers::TonlibApiRequest& request) const {
-    std::stringstream ss;
-    ss << request.http_method << "/" << request.ton_api_method;
-    for (auto& [k, v] : request.args) {
-      ss << "/" << k << ":";
-      bool is_first = true;
-      for (auto& i : v) {
-        if (is_first) {
-          is_first = false;
-        } else {
-          ss << ",";
-        }
-        ss << i;
-      }
-    }
-    return std::hash<std::string>{}(ss.str());
+    return std::hash<std::string>{}(request.ToCacheKey());
   }
 };
 }
@@ -27,7 +27,8 @@ TonlibComponent::TonlibComponent(
             .blockchain_name = "",
             .reset_key_store = false,
             .scheduler_threads = config["threads"].As<std::size_t>(),
-        })
+        }, config["contract_cache_size"].As<std::size_t>(1024), MakeTransactionIndex(config, context),
+        MakeMessageIndex(config))
     ),
     task_processor_(context.GetTaskProcessor(config["task_processor"].As<std::string>())),
     external_message_endpoints_(config["external_message_endpoints"].As<std::vector<std::string>>(std::vector<std::string>{})),
@@ -46,6 +47,38 @@ TonlibComponent::TonlibComponent(
     }
     LOG_WARNING_TO(*logger_) << "Found endpoints: " << ss.str();
   }
+  if (config["message_index_size"].As<std::size_t>(0) > 0) {
+    const auto period = config["message_index_period"].As<std::chrono::milliseconds>(std::chrono::seconds(1));
+    message_indexer_.Start("message_indexer", {period}, [this] {
+      auto status = DoRequest(&TonlibWorker::indexNewBlocks);
+      if (status.is_error()) {
+        LOG_WARNING_TO(*logger_) << "Failed to index new blocks: " << status.to_string();
+      }
+    });
+  }
+}
+
+std::shared_ptr<TransactionChainIndex> TonlibComponent::MakeTransactionIndex(
+    const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context
+) {
+  const auto size = config["transaction_index_size"].As<std::size_t>(TonlibWorker::kDefaultTransactionIndexSize);
+  auto path = config["transaction_index_path"].As<std::optional<std::string>>();
+  if (path.has_value() && path->empty()) {
+    path.reset();
+  }
+  userver::engine::TaskProcessor* fs_task_processor = nullptr;
+  if (path.has_value()) {
+    fs_task_processor = &context.GetTaskProcessor(config["fs_task_processor"].As<std::string>());
+  }
+  return std::make_shared<TransactionChainIndex>(size, path, fs_task_processor);
+}
+
+std::shared_ptr<MessageIndex> TonlibComponent::MakeMessageIndex(const userver::components::ComponentConfig& config) {
+  const auto size = config["message_index_size"].As<std::size_t>(0);
+  if (size == 0) {
+    return nullptr;
+  }
+  return std::make_shared<MessageIndex>(size);
 }
 
 bool TonlibComponent::SendBocToExternalRequest(std::string boc_b64) {
@@ -85,6 +118,29 @@ properties:
     threads:
         type: integer
         description: number of Tonlib threads
+    contract_cache_size:
+        type: integer
+        description: number of loaded smart contracts kept for reuse by get methods, 0 to disable
+        defaultDescription: 1024
+    transaction_index_size:
+        type: integer
+        description: number of transaction chain links kept in memory to page account history in parallel
+        defaultDescription: 131072
+    transaction_index_path:
+        type: string
+        description: path to RocksDB database to persist transaction chain links, empty to keep them in memory only
+        defaultDescription: <empty>
+    fs_task_processor:
+        type: string
+        description: task processor for blocking disk operations, required with transaction_index_path
+    message_index_size:
+        type: integer
+        description: number of recent messages indexed in background to speed up tryLocateTx methods, 0 to disable
+        defaultDescription: 0
+    message_index_period:
+        type: string
+        description: how often new blocks are fed to the message index
+        defaultDescription: 1s
     external_message_endpoints:
         type: array
         description: list of external endpoints for sendBoc method
@@ -7,6 +7,7 @@
 #include "userver/dynamic_config/source.hpp"
 #include "userver/logging/fwd.hpp"
 #include "userver/utils/async.hpp"
+#include "userver/utils/periodic_task.hpp"
 
 namespace ton_http::core {
 class TonlibComponent final : public userver::components::ComponentBase {
@@ -43,9 +44,20 @@ public:
   }
 
   bool SendBocToExternalRequest(std::string boc_b64);
+  std::int32_t GetLastConsensusBlock() const {
+    return worker_->getLastConsensusBlock();
+  }
+  userver::engine::TaskProcessor& GetTaskProcessor() const {
+    return task_processor_;
+  }
 
   static userver::yaml_config::Schema GetStaticConfigSchema();
 private:
+  static std::shared_ptr<TransactionChainIndex> MakeTransactionIndex(
+      const userver::components::ComponentConfig& config, const userver::components::ComponentContext& context
+  );
+  static std::shared_ptr<MessageIndex> MakeMessageIndex(const userver::components::ComponentConfig& config);
+
   userver::dynamic_config::Source config_;
   std::unique_ptr<TonlibWorker> worker_;
   std::unique_ptr<TonlibPostProcessor> postprocessor_;
@@ -53,5 +65,7 @@ private:
   std::vector<std::string> external_message_endpoints_;
   userver::logging::LoggerPtr logger_;
   userver::clients::http::Client& http_client_;
+  // must be the last member, it is stopped before the worker is destroyed
+  userver::utils::PeriodicTask message_indexer_;
 };
 }
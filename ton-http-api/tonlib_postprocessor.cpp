@@ -1,8 +1,12 @@
 #include "tonlib_postprocessor.h"
 
+#include <array>
+
 #include "crypto/common/bitstring.h"
+#include "td/utils/JsonBuilder.h"
 #include "td/utils/overloaded.h"
 #include "userver/formats/json.hpp"
+#include "userver/utils/async.hpp"
 #include "utils.hpp"
 
 namespace ton_http::core {
@@ -382,119 +386,229 @@ TonlibWorkerResponse TonlibPostProcessor::process_getBlockTransactions(
 TonlibWorkerResponse TonlibPostProcessor::process_getBlockTransactionsExt(
     td::Result<tonlib_api::blocks_getTransactionsExt::ReturnType>&& res, multiclient::SessionPtr&& session
 ) const {
-  using namespace userver::formats::json;
   if (res.is_error()) {
     return TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session));
   }
 
   auto result = res.move_as_ok();
-  auto workchain_str = std::to_string(result->id_->workchain_);
+  auto transactions_json = serialize_block_transactions_page(result->transactions_);
+  auto json = td::json_encode<std::string>(td::json_object([&](auto& jo) {
+    jo("@type", "blocks.transactionsExt");
+    jo("id", td::ToJson(result->id_));
+    jo("req_count", result->req_count_);
+    jo("incomplete", td::JsonBool(result->incomplete_));
+    jo("transactions", td::JsonRaw(transactions_json));
+  }));
+  return TonlibWorkerResponse{true, nullptr, std::move(json), std::nullopt, std::move(session)};
+}
 
-  ValueBuilder builder(FromString(td::json_encode<td::string>(td::ToJson(result))));
-  for (size_t i = 0; i < result->transactions_.size(); ++i) {
-    auto r_std_address = block::StdAddress::parse(result->transactions_[i]->address_->account_address_);
+std::string TonlibPostProcessor::serialize_block_transactions_page(const TonlibWorker::TransactionPage& page) const {
+  // the generated tonlib json of a transaction with the raw form of its account added
+  std::string json = "[";
+  for (std::size_t i = 0; i < page.size(); ++i) {
+    if (i > 0) {
+      json += ',';
+    }
+    auto tx_json = td::json_encode<std::string>(td::ToJson(page[i]));
+    auto r_std_address = block::StdAddress::parse(page[i]->address_->account_address_);
     if (r_std_address.is_ok()) {
       const auto std_address = r_std_address.move_as_ok();
-      builder["transactions"][i]["account"] =
-          std::to_string(std_address.workchain) + ":" + td::hex_encode(std_address.addr.as_slice().str());
+      tx_json.pop_back();
+      tx_json += ",\"account\":\"";
+      tx_json += std::to_string(std_address.workchain) + ":" + td::hex_encode(std_address.addr.as_slice().str());
+      tx_json += "\"}";
     }
+    json += tx_json;
   }
-  return TonlibWorkerResponse{true, nullptr, ToString(builder.ExtractValue()), std::nullopt, std::move(session)};
+  json += ']';
+  return json;
 }
 
-TonlibWorkerResponse TonlibPostProcessor::process_getTransactions(
-    td::Result<tonlib_api::raw_getTransactionsV2::ReturnType>&& res,
-    bool v2_schema,
-    bool unwrap_single_transaction,
-    multiclient::SessionPtr&& session
-) const {
-  using namespace userver::formats::json;
-  if (res.is_error()) {
-    return TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session));
-  }
-  auto result = res.move_as_ok();
+// base64 of the data bits of the cell, the last byte is padded with zero bits
+static std::string encode_cell_data(const td::Ref<vm::Cell>& cell) {
+  vm::CellSlice cs = vm::load_cell_slice(cell);
+  std::array<unsigned char, (vm::Cell::max_bits + 7) / 8> buff{};
+  td::bitstring::bits_memcpy(td::BitPtr{buff.data()}, cs.data_bits(), cs.size());
+  return td::base64_encode(td::Slice(buff.data(), (cs.size() + 7) / 8));
+}
 
-  ValueBuilder builder(FromString(td::json_encode<td::string>(td::ToJson(result))));
+namespace {
+// Writers of the api v2 transaction schema straight from tonlib objects. They follow the generated
+// tonlib_api json of raw.message and raw.transaction, except that message source and destination
+// are plain addresses and the decoded body is added as `message`.
+class JsonMessage final : public td::Jsonable {
+public:
+  explicit JsonMessage(const tonlib_api::raw_message& msg) : msg_(msg) {}
 
-  auto process_message_fn = [&](const tonlib_api::object_ptr<tonlib_api::raw_message>& msg, ValueBuilder& builder) {
-    builder["source"] = msg->source_->account_address_;
-    builder["destination"] = msg->destination_->account_address_;
+  void store(td::JsonValueScope* scope) const {
+    auto jo = scope->enter_object();
+    jo("@type", "raw.message");
+    jo("hash", td::ToJson(td::JsonBytes{msg_.hash_}));
+    jo("source", td::JsonString(msg_.source_ ? td::Slice(msg_.source_->account_address_) : td::Slice()));
+    jo("destination", td::JsonString(msg_.destination_ ? td::Slice(msg_.destination_->account_address_) : td::Slice()));
+    jo("value", td::ToJson(td::JsonInt64{msg_.value_}));
+    jo("extra_currencies", td::ToJson(msg_.extra_currencies_));
+    jo("fwd_fee", td::ToJson(td::JsonInt64{msg_.fwd_fee_}));
+    jo("ihr_fee", td::ToJson(td::JsonInt64{msg_.ihr_fee_}));
+    jo("created_lt", td::ToJson(td::JsonInt64{msg_.created_lt_}));
+    jo("body_hash", td::ToJson(td::JsonBytes{msg_.body_hash_}));
+    if (!msg_.msg_data_) {
+      return;
+    }
+    jo("msg_data", td::ToJson(msg_.msg_data_));
 
     auto success = tonlib_api::downcast_call(
-        *msg->msg_data_,
+        *msg_.msg_data_,
         td::overloaded(
             [&](tonlib_api::msg_dataRaw& data) {
               auto r_body = vm::std_boc_deserialize(data.body_);
               if (r_body.is_ok()) {
-                auto body = r_body.move_as_ok();
-                vm::CellSlice cs = vm::load_cell_slice(body);
-                auto body_bs = cs.fetch_bitstring(cs.size());
-                auto body_bin = body_bs->to_binary();
-                for (auto i = body_bin.length() % 8; i % 8 != 0; ++i) {
-                  body_bin += "0";
-                }
-                auto body_slice = td::Slice(body_bin);
-                unsigned char buff[128];
-                td::bitstring::parse_bitstring_binary_literal(
-                    td::BitPtr{buff}, sizeof(buff) * 8, body_slice.begin(), body_slice.end()
-                );
-                auto body_hex = td::bitstring::bits_to_hex(td::ConstBitPtr{buff}, body_bin.length());
-                auto r_body_hex = td::hex_decode(body_hex);
-                if (r_body_hex.is_ok()) {
-                  builder["message"] = td::base64_encode(r_body_hex.move_as_ok());
-                } else {
-                  builder["message_decode_error"] =
-                      r_body_hex.move_as_error_prefix("Failed to decode hex: ").to_string();
-                }
+                jo("message", td::JsonString(encode_cell_data(r_body.ok())));
               } else {
-                builder["message_decode_error"] = r_body.move_as_error_prefix("Failed to decode message: ").to_string();
+                jo("message_decode_error",
+                   td::JsonString(r_body.move_as_error_prefix("Failed to decode message: ").to_string()));
               }
             },
-            [&](tonlib_api::msg_dataText& data) { builder["message"] = data.text_; },
+            [&](tonlib_api::msg_dataText& data) { jo("message", td::JsonString(data.text_)); },
             [&](auto& x) { LOG(WARNING) << "failed to decode type " << x.get_id(); }
         )
     );
     if (!success) {
       LOG(WARNING) << "error in downcast_call";
     }
-  };
-  for (size_t i = 0; i < result->transactions_.size(); ++i) {
-    auto& tx = result->transactions_[i];
-    auto& in_msg = tx->in_msg_;
-    if (in_msg) {
-      auto local_builder = builder["transactions"][i]["in_msg"];
-      process_message_fn(in_msg, local_builder);
+  }
+
+private:
+  const tonlib_api::raw_message& msg_;
+};
+
+class JsonTransaction final : public td::Jsonable {
+public:
+  explicit JsonTransaction(const tonlib_api::raw_transaction& tx) : tx_(tx) {}
+
+  void store(td::JsonValueScope* scope) const {
+    auto jo = scope->enter_object();
+    jo("@type", "raw.transaction");
+    if (tx_.address_) {
+      jo("address", td::ToJson(tx_.address_));
+    }
+    jo("utime", tx_.utime_);
+    jo("data", td::ToJson(td::JsonBytes{tx_.data_}));
+    if (tx_.transaction_id_) {
+      jo("transaction_id", td::ToJson(tx_.transaction_id_));
     }
-    for (size_t j = 0; j < tx->out_msgs_.size(); ++j) {
-      auto local_builder = builder["transactions"][i]["out_msgs"][j];
-      process_message_fn(tx->out_msgs_[j], local_builder);
+    jo("fee", td::ToJson(td::JsonInt64{tx_.fee_}));
+    jo("storage_fee", td::ToJson(td::JsonInt64{tx_.storage_fee_}));
+    jo("other_fee", td::ToJson(td::JsonInt64{tx_.other_fee_}));
+    if (tx_.in_msg_) {
+      jo("in_msg", JsonMessage(*tx_.in_msg_));
     }
+    jo("out_msgs", td::json_array(tx_.out_msgs_, [](const auto& msg) { return JsonMessage(*msg); }));
   }
 
-  if (v2_schema) {
-    return TonlibWorkerResponse{true, nullptr, ToString(builder.ExtractValue()), std::nullopt, std::move(session)};
+private:
+  const tonlib_api::raw_transaction& tx_;
+};
+
+// raw.transactions of the v2 schema around an already serialized list of transactions
+class JsonTransactions final : public td::Jsonable {
+public:
+  JsonTransactions(const tonlib_api::raw_transactions& txs, td::Slice transactions_json) :
+      txs_(txs), transactions_json_(transactions_json) {}
+
+  void store(td::JsonValueScope* scope) const {
+    auto jo = scope->enter_object();
+    jo("@type", "raw.transactions");
+    jo("transactions", td::JsonRaw(transactions_json_));
+    if (txs_.previous_transaction_id_) {
+      jo("previous_transaction_id", td::ToJson(txs_.previous_transaction_id_));
+    }
+  }
+
+private:
+  const tonlib_api::raw_transactions& txs_;
+  td::Slice transactions_json_;
+};
+
+// json array of transactions [begin, end)
+std::string serialize_transactions(const TonlibWorker::TransactionPage& txs, std::size_t begin, std::size_t end) {
+  return td::json_encode<std::string>(td::json_array([&](auto& arr) {
+    for (auto i = begin; i < end; ++i) {
+      arr(JsonTransaction(*txs[i]));
+    }
+  }));
+}
+
+// large pages are split into chunks serialized concurrently, message decoding dominates the cost
+std::string serialize_transactions(const TonlibWorker::TransactionPage& txs) {
+  static constexpr std::size_t kParallelThreshold = 64;
+  static constexpr std::size_t kChunkSize = 32;
+
+  const auto count = txs.size();
+  if (count < kParallelThreshold) {
+    return serialize_transactions(txs, 0, count);
   }
-  if (unwrap_single_transaction && result->transactions_.size() == 1) {
-    return TonlibWorkerResponse{
-        true, nullptr, ToString(builder.ExtractValue()["transactions"][0]), std::nullopt, std::move(session)
-    };
+  std::vector<userver::engine::TaskWithResult<std::string>> tasks;
+  tasks.reserve((count + kChunkSize - 1) / kChunkSize);
+  for (std::size_t begin = 0; begin < count; begin += kChunkSize) {
+    const auto end = std::min(begin + kChunkSize, count);
+    tasks.push_back(userver::utils::Async("serialize_transactions", [&txs, begin, end] {
+      return serialize_transactions(txs, begin, end);
+    }));
   }
-  return TonlibWorkerResponse{
-      true, nullptr, ToString(builder.ExtractValue()["transactions"]), std::nullopt, std::move(session)
-  };
+
+  // chunks are arrays themselves, their items are joined into one array in order
+  std::vector<std::string> chunks;
+  chunks.reserve(tasks.size());
+  std::size_t size = 2;
+  for (auto& task : tasks) {
+    chunks.push_back(task.Get());
+    size += chunks.back().size();
+  }
+  std::string json;
+  json.reserve(size);
+  json += '[';
+  for (std::size_t i = 0; i < chunks.size(); ++i) {
+    if (i > 0) {
+      json += ',';
+    }
+    json.append(chunks[i], 1, chunks[i].size() - 2);
+  }
+  json += ']';
+  return json;
+}
+}  // namespace
+
+TonlibWorkerResponse TonlibPostProcessor::process_getTransactions(
+    td::Result<tonlib_api::raw_getTransactionsV2::ReturnType>&& res,
+    bool v2_schema,
+    bool unwrap_single_transaction,
+    multiclient::SessionPtr&& session
+) const {
+  if (res.is_error()) {
+    return TonlibWorkerResponse::from_tonlib_result(std::move(res), std::move(session));
+  }
+  auto result = res.move_as_ok();
+
+  if (!v2_schema && unwrap_single_transaction && result->transactions_.size() == 1) {
+    auto json = td::json_encode<std::string>(JsonTransaction(*result->transactions_[0]));
+    return TonlibWorkerResponse{true, nullptr, std::move(json), std::nullopt, std::move(session)};
+  }
+  auto json = serialize_transactions(result->transactions_);
+  if (v2_schema) {
+    json = td::json_encode<std::string>(JsonTransactions(*result, json));
+  }
+  return TonlibWorkerResponse{true, nullptr, std::move(json), std::nullopt, std::move(session)};
+}
+std::string TonlibPostProcessor::serialize_transactions_page(const TonlibWorker::TransactionPage& page) const {
+  return serialize_transactions(page);
 }
 TonlibWorkerResponse TonlibPostProcessor::process_runGetMethod(
     td::Result<RunGetMethodResult>&& res, multiclient::SessionPtr&& session
 ) const {
-  using namespace userver::formats::json;
   if (res.is_error()) {
     return TonlibWorkerResponse::from_error_string(res.move_as_error().to_string(), 503, std::move(session));
   }
-  auto result = res.move_as_ok();
-
-  ValueBuilder builder(FromString(result.to_json_string()));
-  builder["stack"] = utils::serialize_tvm_stack(result.result->stack_);
-  auto ress = ToString(builder.ExtractValue());
-  return TonlibWorkerResponse{true, nullptr, ress, std::nullopt, std::move(session)};
+  return TonlibWorkerResponse{true, nullptr, res.ok().to_json_string(), std::nullopt, std::move(session)};
 }
 }  // namespace ton_http::core
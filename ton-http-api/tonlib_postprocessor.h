@@ -13,5 +13,9 @@ public:
   TonlibWorkerResponse process_getBlockTransactionsExt(td::Result<tonlib_api::blocks_getTransactionsExt::ReturnType>&& res, multiclient::SessionPtr&& session = nullptr) const;
   TonlibWorkerResponse process_getTransactions(td::Result<tonlib_api::raw_getTransactionsV2::ReturnType>&& res, bool v2_schema = true, bool unwrap_single_transaction = false, multiclient::SessionPtr&& session = nullptr) const;
   TonlibWorkerResponse process_runGetMethod(td::Result<RunGetMethodResult>&& res, multiclient::SessionPtr&& session = nullptr) const;
+
+  // json arrays of transaction pages in the schemas of getTransactions (v2) and getBlockTransactionsExt
+  std::string serialize_transactions_page(const TonlibWorker::TransactionPage& page) const;
+  std::string serialize_block_transactions_page(const TonlibWorker::TransactionPage& page) const;
 };
 }
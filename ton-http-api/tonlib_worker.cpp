@@ -1,22 +1,69 @@
 #include "tonlib_worker.h"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <limits>
+#include <map>
+#include <shared_mutex>
 #include <utility>
 
+#include "td/utils/crypto.h"
+#include "userver/engine/semaphore.hpp"
+#include "userver/engine/wait_any.hpp"
 #include "userver/formats/json.hpp"
+#include "userver/utils/async.hpp"
+#include "userver/utils/scope_guard.hpp"
 #include "utils.hpp"
 
 namespace ton_http::core {
 
-template<typename T>
-auto tl_to_json(const T& value) {
-  return userver::formats::json::FromString(td::json_encode<td::string>(td::ToJson(value)));
-}
-
 template <typename T1, typename T2>
 auto value_or_default(const std::optional<T1>& arg, const T2& def) {
   return (arg.has_value() ? arg.value() : (def));
 }
 
+// token checks fail with this code when a get method couldn't run at all, unlike contracts of another kind
+static constexpr int kTokenCheckUnavailable = 503;
+static td::Status token_check_unavailable(td::Status error) {
+  return td::Status::Error(kTokenCheckUnavailable, PSLICE() << "Token check failed: " << error.message());
+}
+
+// tonlib answers this way for ids of contracts it doesn't hold, f.e. after its client was restarted
+static bool is_lost_contract_error(const td::Status& error) {
+  return error.message().str().find("INVALID_SMC_ID") != std::string::npos;
+}
+
+// raw form of the address, so that every form of it maps to the same transaction chain
+static std::string transaction_index_account(const std::string& address) {
+  auto r_std_address = block::StdAddress::parse(address);
+  if (r_std_address.is_error()) {
+    return address;
+  }
+  td::StringBuilder sb;
+  sb << r_std_address.ok().workchain << ":" << r_std_address.ok().addr.to_hex();
+  return sb.as_cslice().str();
+}
+
+static constexpr size_t kBlockScanChunkSize = 256;
+static constexpr size_t kBlockScanRanges = 4;
+
+// the first 64 bits of an account id, enough to tell the scan range it belongs to
+static std::uint64_t account_prefix(td::Slice account) {
+  std::uint64_t res = 0;
+  for (size_t i = 0; i < 8; ++i) {
+    res = (res << 8) | (i < account.size() ? account.ubegin()[i] : 0);
+  }
+  return res;
+}
+static std::string account_from_prefix(std::uint64_t prefix) {
+  std::string res(32, '\0');
+  for (size_t i = 0; i < 8; ++i) {
+    res[i] = static_cast<char>((prefix >> (56 - 8 * i)) & 0xff);
+  }
+  return res;
+}
+
 std::string DetectAddressResult::to_json_string() const {
   using namespace userver::formats::json;
 
@@ -64,17 +111,32 @@ std::string ConsensusBlockResult::to_json_string() const {
   return std::move(res);
 }
 std::string RunGetMethodResult::to_json_string() const {
-  using namespace userver::formats::json;
+  class JsonResult final : public td::Jsonable {
+  public:
+    explicit JsonResult(const RunGetMethodResult& res) : res_(res) {}
+
+    void store(td::JsonValueScope* scope) const {
+      auto jo = scope->enter_object();
+      jo("@type", "smc.runResult");
+      jo("gas_used", res_.result->gas_used_);
+      jo("stack", utils::JsonTvmStack(res_.result->stack_));
+      jo("exit_code", res_.result->exit_code_);
+      jo("block_id", td::ToJson(res_.state->block_id_));
+      jo("last_transaction_id", td::ToJson(res_.state->last_transaction_id_));
+    }
 
-  ValueBuilder builder(tl_to_json(result));
-  builder["block_id"] = tl_to_json(state->block_id_);
-  builder["last_transaction_id"] = tl_to_json(state->last_transaction_id_);
-  return std::move(ToString(builder.ExtractValue()));
+  private:
+    const RunGetMethodResult& res_;
+  };
+  return td::json_encode<std::string>(JsonResult(*this));
 }
 
 std::string TokenDataResult::to_json_string() const {
   return "{\"error\": \"why?\"}";
 }
+std::unique_ptr<TokenDataResult> TokenDataResult::clone() const {
+  return std::make_unique<TokenDataResult>(*this);
+}
 
 std::string JettonMasterDataResult::to_json_string() const {
   using namespace userver::formats::json;
@@ -99,6 +161,9 @@ std::string JettonMasterDataResult::to_json_string() const {
   builder["jetton_wallet_code"] = jetton_wallet_code_;
   return std::move(ToString(builder.ExtractValue()));
 }
+std::unique_ptr<TokenDataResult> JettonMasterDataResult::clone() const {
+  return std::make_unique<JettonMasterDataResult>(*this);
+}
 
 std::string JettonWalletDataResult::to_json_string() const {
   using namespace userver::formats::json;
@@ -116,6 +181,9 @@ std::string JettonWalletDataResult::to_json_string() const {
   builder["is_validated"] = is_validated_;
   return std::move(ToString(builder.ExtractValue()));
 }
+std::unique_ptr<TokenDataResult> JettonWalletDataResult::clone() const {
+  return std::make_unique<JettonWalletDataResult>(*this);
+}
 
 std::string NFTCollectionDataResult::to_json_string() const {
   using namespace userver::formats::json;
@@ -140,6 +208,9 @@ std::string NFTCollectionDataResult::to_json_string() const {
   }
   return std::move(ToString(builder.ExtractValue()));
 }
+std::unique_ptr<TokenDataResult> NFTCollectionDataResult::clone() const {
+  return std::make_unique<NFTCollectionDataResult>(*this);
+}
 
 std::string NFTItemDataResult::to_json_string() const {
   using namespace userver::formats::json;
@@ -169,6 +240,9 @@ std::string NFTItemDataResult::to_json_string() const {
   builder["is_validated"] = is_validated_;
   return std::move(ToString(builder.ExtractValue()));
 }
+std::unique_ptr<TokenDataResult> NFTItemDataResult::clone() const {
+  return std::make_unique<NFTItemDataResult>(*this);
+}
 
 TonlibWorker::Result<ConsensusBlockResult> TonlibWorker::getConsensusBlock(multiclient::SessionPtr session) const {
   auto res = tonlib_.get_consensus_block();
@@ -217,6 +291,30 @@ TonlibWorker::Result<DetectHashResult> TonlibWorker::detectHash(
   return {std::move(result), session};
 }
 
+td::Result<TonlibWorker::TokenContent> TonlibWorker::parseTokenContent(const std::string& boc) const {
+  auto key = td::sha256(boc);
+  {
+    std::lock_guard lock(token_content_cache_mutex_);
+    if (const auto* content = token_content_cache_.Get(key)) {
+      return *content;
+    }
+  }
+
+  auto r_cell = vm::std_boc_deserialize(boc, true, true);
+  if (r_cell.is_error()) {
+    return r_cell.move_as_error_prefix("Failed to deserialize content cell: ");
+  }
+  auto r_content = utils::parse_token_data(r_cell.move_as_ok());
+  if (r_content.is_error()) {
+    return r_content.move_as_error();
+  }
+  auto content = r_content.move_as_ok();
+
+  std::lock_guard lock(token_content_cache_mutex_);
+  token_content_cache_.Put(key, content);
+  return content;
+}
+
 TonlibWorker::Result<TokenDataResultPtr> TonlibWorker::getTokenData(
   const std::string& address,
   bool skip_verification,
@@ -224,46 +322,156 @@ TonlibWorker::Result<TokenDataResultPtr> TonlibWorker::getTokenData(
   std::optional<bool> archival,
     multiclient::SessionPtr session
 ) const {
-  auto [r_jetton_master, _s1] = checkJettonMaster(address, skip_verification, seqno, archival, session);
-  auto [r_jetton_wallet, _s2] = checkJettonWallet(address, skip_verification, seqno, archival, session);
-  auto [r_nft_collection, _s3] = checkNFTCollection(address, skip_verification, seqno, archival, session);
-  auto [r_nft_item, _s4] = checkNFTItem(address, skip_verification, seqno, archival, session);
+  if (seqno.has_value()) {
+    auto [r_detected, new_session] = detectTokenData(address, skip_verification, seqno, archival, std::nullopt, session);
+    if (r_detected.is_error()) {
+      return {r_detected.move_as_error(), new_session};
+    }
+    return {std::move(r_detected.ok_ref().second), new_session};
+  }
 
-  if (r_jetton_master.is_ok()) {
-    auto data = r_jetton_master.move_as_ok();
-    if (data) {
-      return {std::move(data), std::move(session)};
+  // the latest data is reused until the account gets a new transaction,
+  // the kind of the token is kept for as long as the contract code stays the same
+  auto [r_state, new_session] = getAddressInformation(address, std::nullopt, session);
+  session = std::move(new_session);
+  if (r_state.is_error()) {
+    return {r_state.move_as_error(), session};
+  }
+  auto state = r_state.move_as_ok();
+  if (!state->last_transaction_id_ || !state->block_id_) {
+    return {td::Status::Error(409, PSLICE() << "Smart contract " << address << " is not Jetton or NFT"), session};
+  }
+  const auto key = transaction_index_account(address) + ":" + td::sha256(state->code_) + (skip_verification ? ":1" : ":0");
+  const TransactionId last_transaction_id{state->last_transaction_id_->lt_, state->last_transaction_id_->hash_};
+
+  std::shared_ptr<const TokenDataCacheEntry> entry;
+  {
+    std::lock_guard lock(token_data_cache_mutex_);
+    if (const auto* cached = token_data_cache_.Get(key)) {
+      entry = *cached;
     }
-  } else {
-    LOG(DEBUG) << "Jetton master: " << r_jetton_master.move_as_error();
   }
-  if (r_jetton_wallet.is_ok()) {
-    auto data = r_jetton_wallet.move_as_ok();
-    if (data) {
-      return {std::move(data), std::move(session)};
+  if (entry && entry->last_transaction_id.lt == last_transaction_id.lt &&
+      entry->last_transaction_id.hash == last_transaction_id.hash) {
+    if (!entry->data) {
+      return {td::Status::Error(409, PSLICE() << "Smart contract " << address << " is not Jetton or NFT"), session};
     }
-  } else {
-    LOG(DEBUG) << "Jetton wallet: " << r_jetton_wallet.move_as_error();
+    return {entry->data->clone(), session};
   }
 
-  if (r_nft_collection.is_ok()) {
-    auto data = r_nft_collection.move_as_ok();
-    if (data) {
-      return {std::move(data), std::move(session)};
-    }
-  } else {
-    LOG(DEBUG) << "NFT collection: " << r_nft_collection.move_as_error();
+  // get methods run at the block the state was read at, so the result matches the transaction it is cached with
+  std::optional<ton::BlockSeqno> state_seqno;
+  if (state->block_id_->workchain_ == ton::masterchainId) {
+    state_seqno = static_cast<ton::BlockSeqno>(state->block_id_->seqno_);
   }
+  const auto kind = entry ? entry->kind : std::nullopt;
+  auto [r_detected, detect_session] = detectTokenData(address, skip_verification, state_seqno, archival, kind, session);
+  if (r_detected.is_error() && r_detected.error().code() == 409 && kind.has_value()) {
+    LOG(DEBUG) << "Token data of " << address << " doesn't match its previous kind: " << r_detected.error();
+    std::tie(r_detected, detect_session) =
+        detectTokenData(address, skip_verification, state_seqno, archival, std::nullopt, session);
+  }
+  session = std::move(detect_session);
 
-  if (r_nft_item.is_ok()) {
-    auto data = r_nft_item.move_as_ok();
-    if (data) {
-      return {std::move(data), std::move(session)};
+  auto new_entry = std::make_shared<TokenDataCacheEntry>();
+  new_entry->last_transaction_id = last_transaction_id;
+  if (r_detected.is_error()) {
+    if (r_detected.error().code() != 409) {
+      return {r_detected.move_as_error(), session};
     }
-  } else {
-    LOG(DEBUG) << "NFT item: " << r_nft_item.move_as_error();
+    std::lock_guard lock(token_data_cache_mutex_);
+    token_data_cache_.Put(key, std::move(new_entry));
+    return {r_detected.move_as_error(), session};
+  }
+  auto [detected_kind, data] = r_detected.move_as_ok();
+  new_entry->kind = detected_kind;
+  new_entry->data = data->clone();
+  std::lock_guard lock(token_data_cache_mutex_);
+  token_data_cache_.Put(key, std::move(new_entry));
+  return {std::move(data), session};
+}
+
+TonlibWorker::Result<std::pair<std::size_t, TokenDataResultPtr>> TonlibWorker::detectTokenData(
+    const std::string& address,
+    bool skip_verification,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    std::optional<std::size_t> kind,
+    multiclient::SessionPtr session
+) const {
+  // the contract is loaded once and shared by all probes, so the session has to stay pinned to the same worker
+  auto [r_handle, new_session] = acquireContract(address, seqno, archival, session);
+  session = std::move(new_session);
+  if (!r_handle.is_ok()) {
+    return {r_handle.move_as_error(), session};
+  }
+  auto handle = r_handle.move_as_ok();
+  const auto smc_id = handle->id;
+
+  using CheckMethod = Result<TokenDataResultPtr> (TonlibWorker::*)(
+      const std::string&, std::int64_t, bool, std::optional<ton::BlockSeqno>, std::optional<bool>, multiclient::SessionPtr
+  ) const;
+  static constexpr std::array<std::pair<CheckMethod, std::string_view>, 4> kChecks{{
+      {&TonlibWorker::checkJettonMaster, "Jetton master"},
+      {&TonlibWorker::checkJettonWallet, "Jetton wallet"},
+      {&TonlibWorker::checkNFTCollection, "NFT collection"},
+      {&TonlibWorker::checkNFTItem, "NFT item"},
+  }};
+
+  // a known kind of the token is checked alone
+  std::vector<std::size_t> probes;
+  for (std::size_t i = 0; i < kChecks.size(); ++i) {
+    if (!kind.has_value() || kind.value() == i) {
+      probes.push_back(i);
+    }
+  }
+  std::vector<userver::engine::TaskWithResult<Result<TokenDataResultPtr>>> tasks;
+  tasks.reserve(probes.size());
+  for (auto probe : probes) {
+    // each probe gets its own copy of the session, so they don't share a mutable SessionPtr
+    auto probe_session = std::make_shared<multiclient::Session>(*session);
+    tasks.push_back(userver::utils::Async(
+        "gettokendata_check",
+        [this, &address, smc_id, skip_verification, seqno, archival, check = kChecks[probe].first,
+         probe_session = std::move(probe_session)] {
+          return (this->*check)(address, smc_id, skip_verification, seqno, archival, probe_session);
+        }
+    ));
+  }
+
+  // probes are awaited in priority order, the first positive one cancels the rest
+  TokenDataResultPtr data;
+  std::size_t detected_kind = 0;
+  std::optional<td::Status> unavailable;
+  for (std::size_t i = 0; i < tasks.size() && !data; ++i) {
+    auto [r_data, _s] = tasks[i].Get();
+    if (r_data.is_error()) {
+      auto error = r_data.move_as_error();
+      LOG(DEBUG) << kChecks[probes[i]].second << ": " << error;
+      if (error.code() == kTokenCheckUnavailable && !unavailable.has_value()) {
+        unavailable = std::move(error);
+      }
+      continue;
+    }
+    // null data is a definite mismatch
+    data = r_data.move_as_ok();
+    detected_kind = probes[i];
+  }
+  tasks.clear();
+
+  // the next request loads the contract again instead of failing on the same handle
+  if (unavailable.has_value()) {
+    invalidateLostContract(address, seqno, handle, unavailable.value());
   }
+  releaseContract(std::move(handle));
 
+  if (data) {
+    return {std::make_pair(detected_kind, std::move(data)), std::move(session)};
+  }
+  // the contract is only known not to be a token if every check could run
+  if (unavailable.has_value()) {
+    return {std::move(unavailable.value()), std::move(session)};
+  }
   return {td::Status::Error(409, PSLICE() << "Smart contract " << address << " is not Jetton or NFT"), std::move(session)};
 }
 TonlibWorker::Result<tonlib_api::blocks_getMasterchainInfo::ReturnType> TonlibWorker::getMasterchainInfo(multiclient::SessionPtr session) const {
@@ -418,6 +626,17 @@ TonlibWorker::Result<tonlib_api::blocks_lookupBlock::ReturnType> TonlibWorker::l
     lookupMode += 4;
   }
 
+  const bool is_mc_seqno_lookup = workchain == ton::masterchainId && lookupMode == 1;
+  if (is_mc_seqno_lookup) {
+    std::lock_guard lock(mc_block_cache_mutex_);
+    if (const auto* blk_id = mc_block_cache_.Get(seqno.value())) {
+      return {tonlib_api::make_object<tonlib_api::ton_blockIdExt>(
+          blk_id->id.workchain, blk_id->id.shard, blk_id->id.seqno,
+          blk_id->root_hash.as_slice().str(), blk_id->file_hash.as_slice().str()
+      ), session};
+    }
+  }
+
   // try non-archival
   auto request = multiclient::RequestFunction<tonlib_api::blocks_lookupBlock>{
       .parameters = {.mode = multiclient::RequestMode::Single},
@@ -433,8 +652,25 @@ TonlibWorker::Result<tonlib_api::blocks_lookupBlock::ReturnType> TonlibWorker::l
       .session = session
   };
   auto [result, new_session] = send_request_function(std::move(request), true);
+  if (is_mc_seqno_lookup && result.is_ok()) {
+    rememberMasterchainBlock(*result.ok());
+  }
   return {std::move(result), new_session};
 }
+void TonlibWorker::rememberMasterchainBlock(const tonlib_api::ton_blockIdExt& blk_id) const {
+  ton::RootHash root_hash;
+  ton::FileHash file_hash;
+  if (blk_id.root_hash_.size() != root_hash.size() / 8 || blk_id.file_hash_.size() != file_hash.size() / 8) {
+    return;
+  }
+  root_hash.as_slice().copy_from(blk_id.root_hash_);
+  file_hash.as_slice().copy_from(blk_id.file_hash_);
+  std::lock_guard lock(mc_block_cache_mutex_);
+  mc_block_cache_.Put(
+      static_cast<ton::BlockSeqno>(blk_id.seqno_),
+      ton::BlockIdExt{blk_id.workchain_, static_cast<ton::ShardId>(blk_id.shard_), static_cast<ton::BlockSeqno>(blk_id.seqno_), root_hash, file_hash}
+  );
+}
 TonlibWorker::Result<tonlib_api::blocks_getShardBlockProof::ReturnType> TonlibWorker::getShardBlockProof(
     const ton::WorkchainId& workchain,
     const ton::ShardId& shard,
@@ -674,22 +910,62 @@ TonlibWorker::Result<tonlib_api::getConfigParam::ReturnType> TonlibWorker::getCo
 TonlibWorker::Result<std::unique_ptr<tonlib_api::smc_libraryResult>> TonlibWorker::getLibraries(
     std::vector<std::string> libs, multiclient::SessionPtr session
 ) const {
-  auto request = multiclient::RequestFunction<tonlib_api::smc_getLibraries>{
-    .parameters = {.mode = multiclient::RequestMode::Single},
-    .request_creator =
-        [libs] {
-          std::vector<td::Bits256> lib_hashes;
-          for (auto& lib : libs) {
-            td::Bits256 hash;
-            hash.as_slice().copy_from(lib);
-            lib_hashes.push_back(std::move(hash));
-          }
-          return tonlib_api::make_object<tonlib_api::smc_getLibraries>(std::move(lib_hashes));
-    },
-    .session = std::move(session)
-  };
-  auto [result, new_session] = send_request_function(std::move(request), true);
-  return {std::move(result), new_session};
+  std::map<std::string, std::string> found;
+  std::vector<std::string> missing;
+  {
+    std::lock_guard lock(library_cache_mutex_);
+    for (auto& lib : libs) {
+      if (const auto* data = library_cache_.Get(lib)) {
+        found.emplace(lib, *data);
+      } else if (!found.contains(lib)) {
+        missing.push_back(lib);
+      }
+    }
+  }
+
+  if (!missing.empty()) {
+    auto request = multiclient::RequestFunction<tonlib_api::smc_getLibraries>{
+      .parameters = {.mode = multiclient::RequestMode::Single},
+      .request_creator =
+          [missing] {
+            std::vector<td::Bits256> lib_hashes;
+            for (auto& lib : missing) {
+              td::Bits256 hash;
+              hash.as_slice().copy_from(lib);
+              lib_hashes.push_back(std::move(hash));
+            }
+            return tonlib_api::make_object<tonlib_api::smc_getLibraries>(std::move(lib_hashes));
+      },
+      .session = std::move(session)
+    };
+    auto [result, new_session] = send_request_function(std::move(request), true);
+    session = std::move(new_session);
+    if (result.is_error()) {
+      return {result.move_as_error(), session};
+    }
+
+    auto libraries = result.move_as_ok();
+    std::lock_guard lock(library_cache_mutex_);
+    for (auto& entry : libraries->result_) {
+      auto hash = entry->hash_.as_slice().str();
+      library_cache_.Put(hash, entry->data_);
+      found.emplace(std::move(hash), std::move(entry->data_));
+    }
+  }
+
+  // libraries unknown to the liteserver are omitted, as in the tonlib response
+  std::vector<tonlib_api::object_ptr<tonlib_api::smc_libraryEntry>> entries;
+  for (auto& lib : libs) {
+    auto it = found.find(lib);
+    if (it == found.end()) {
+      continue;
+    }
+    td::Bits256 hash;
+    hash.as_slice().copy_from(lib);
+    entries.push_back(tonlib_api::make_object<tonlib_api::smc_libraryEntry>(hash, std::move(it->second)));
+    found.erase(it);
+  }
+  return {tonlib_api::make_object<tonlib_api::smc_libraryResult>(std::move(entries)), session};
 }
 TonlibWorker::Result<tonlib_api::blocks_getTransactions::ReturnType> TonlibWorker::raw_getBlockTransactions(
     const tonlib_api::object_ptr<tonlib_api::ton_blockIdExt>& blk_id,
@@ -823,8 +1099,128 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
     .session = std::move(session)
   };
   auto [result, new_session] = send_request_function(std::move(request), !archival.has_value());
+  if (result.is_ok()) {
+    tx_index_->Remember(transaction_index_account(account_address), *result.ok());
+  }
   return {std::move(result), new_session};
 }
+template <typename T, typename Fetch, typename TxCursor, typename OnPage>
+TonlibWorker::Result<tonlib_api::object_ptr<T>> TonlibWorker::scanBlockTransactions(
+    const tonlib_api::object_ptr<tonlib_api::ton_blockIdExt>& blk_id,
+    size_t count,
+    std::optional<bool> archival,
+    multiclient::SessionPtr session,
+    Fetch fetch,
+    TxCursor tx_cursor,
+    OnPage on_page
+) const {
+  using TxPtr = typename decltype(T::transactions_)::value_type;
+  struct RangeResult {
+    std::vector<TxPtr> transactions;
+    bool is_complete{false};
+    tonlib_api::object_ptr<tonlib_api::ton_blockIdExt> id;
+  };
+
+  // accounts of the shard share its prefix, so the ranges split [shard - lowbit, shard + lowbit)
+  const auto shard = static_cast<std::uint64_t>(blk_id->shard_);
+  const auto shard_lowbit = shard & (~shard + 1);
+  const auto range_width = shard_lowbit / (kBlockScanRanges / 2);
+  std::vector<std::uint64_t> bounds;
+  for (size_t i = 0; i < kBlockScanRanges; ++i) {
+    bounds.push_back(shard - shard_lowbit + i * range_width);
+  }
+
+  // transactions fetched by each range so far; a range needs to fetch only what the ranges before it
+  // and itself haven't filled of `count` yet, the rest of it would be cut from the response anyway
+  std::vector<std::atomic<size_t>> fetched(bounds.size());
+  const auto budget_left = [&](size_t range_idx) -> size_t {
+    size_t total = 0;
+    for (size_t i = 0; i <= range_idx; ++i) {
+      total += fetched[i].load();
+    }
+    return count - std::min(total, count);
+  };
+
+  // the range is scanned within its budget or until the first account of the next range
+  auto scan_range = [&](size_t range_idx, multiclient::SessionPtr range_session) -> td::Result<RangeResult> {
+    const auto end = range_idx + 1 < bounds.size() ? std::optional{bounds[range_idx + 1]} : std::nullopt;
+    auto after = tonlib_api::make_object<tonlib_api::blocks_accountTransactionId>(account_from_prefix(bounds[range_idx]), 0);
+    RangeResult res;
+    // a range retried on the original session starts over
+    fetched[range_idx] = 0;
+    while (true) {
+      const auto budget = budget_left(range_idx);
+      if (budget == 0) {
+        return res;
+      }
+      auto [result, new_session] = (this->*fetch)(
+          blk_id, std::min(kBlockScanChunkSize, budget), std::move(after), archival, range_session
+      );
+      if (result.is_error()) {
+        return result.move_as_error();
+      }
+      auto local = result.move_as_ok();
+      range_session = std::move(new_session);
+      res.id = std::move(local->id_);
+
+      for (auto& tx : local->transactions_) {
+        if (end.has_value() && account_prefix(tx_cursor(*tx).first) >= end.value()) {
+          res.is_complete = true;
+          return res;
+        }
+        res.transactions.push_back(std::move(tx));
+        ++fetched[range_idx];
+      }
+      if (!local->incomplete_ || local->transactions_.empty()) {
+        res.is_complete = !local->incomplete_;
+        return res;
+      }
+      auto [account, lt] = tx_cursor(*res.transactions.back());
+      after = tonlib_api::make_object<tonlib_api::blocks_accountTransactionId>(std::move(account), lt);
+    }
+  };
+
+  // ranges go to independent sessions to spread over workers, a failed one is retried on the original session
+  std::vector<userver::engine::TaskWithResult<td::Result<RangeResult>>> tasks;
+  for (size_t i = 0; i < bounds.size(); ++i) {
+    tasks.push_back(userver::utils::Async("block_scan_range", [&scan_range, i] { return scan_range(i, nullptr); }));
+  }
+
+  // ranges are handed over in order as soon as all the ones before them are done
+  size_t passed_count = 0;
+  tonlib_api::object_ptr<tonlib_api::ton_blockIdExt> id;
+  bool incomplete = false;
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    auto r_range = tasks[i].Get();
+    if (r_range.is_error()) {
+      LOG(WARNING) << "Block scan range " << i << " failed: " << r_range.error();
+      r_range = scan_range(i, session);
+      if (r_range.is_error()) {
+        return {r_range.move_as_error(), session};
+      }
+    }
+    auto range = r_range.move_as_ok();
+    // a range stopped before its first fetch has no id
+    if (range.id) {
+      id = std::move(range.id);
+    }
+    // a range cut by the limit leaves a gap before the next one
+    const bool is_cut = !range.is_complete || passed_count + range.transactions.size() > count;
+    if (range.transactions.size() > count - passed_count) {
+      range.transactions.resize(count - passed_count);
+    }
+    passed_count += range.transactions.size();
+    on_page(std::move(range.transactions));
+    if (is_cut) {
+      incomplete = true;
+      break;
+    }
+  }
+  return {
+      tonlib_api::make_object<T>(std::move(id), static_cast<std::int32_t>(count), incomplete, std::vector<TxPtr>{}),
+      session
+  };
+}
 TonlibWorker::Result<tonlib_api::blocks_getTransactions::ReturnType> TonlibWorker::getBlockTransactions(
     const ton::WorkchainId& workchain,
     const ton::ShardId& shard,
@@ -857,6 +1253,23 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactions::ReturnType> TonlibWorke
     session = std::move(new_session);
   }
 
+  // a whole block from the start is scanned in parallel ranges
+  if (!after_lt.has_value() && count > kBlockScanChunkSize) {
+    std::vector<tonlib_api::object_ptr<tonlib_api::blocks_shortTxId>> transactions;
+    transactions.reserve(count);
+    auto [r_txs, new_session] = scanBlockTransactions<tonlib_api::blocks_transactions>(
+        blk_id, count, archival, session, &TonlibWorker::raw_getBlockTransactions,
+        [](const tonlib_api::blocks_shortTxId& tx) { return std::make_pair(tx.account_, tx.lt_); },
+        [&transactions](std::vector<tonlib_api::object_ptr<tonlib_api::blocks_shortTxId>>&& page) {
+          std::move(page.begin(), page.end(), std::back_inserter(transactions));
+        }
+    );
+    if (r_txs.is_ok()) {
+      r_txs.ok_ref()->transactions_ = std::move(transactions);
+    }
+    return {std::move(r_txs), new_session};
+  }
+
   tonlib_api::object_ptr<tonlib_api::blocks_accountTransactionId> after;
   if (after_lt.has_value()) {
     after = tonlib_api::make_object<tonlib_api::blocks_accountTransactionId>(after_hash, after_lt.value());
@@ -868,7 +1281,7 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactions::ReturnType> TonlibWorke
 
   size_t left_count = count;
   bool is_finished = false;
-  constexpr size_t CHUNK_SIZE = 256;
+  constexpr size_t CHUNK_SIZE = kBlockScanChunkSize;
 
   tonlib_api::object_ptr<tonlib_api::blocks_transactions> txs =
       tonlib_api::make_object<tonlib_api::blocks_transactions>(
@@ -918,6 +1331,33 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactionsExt::ReturnType> TonlibWo
     const std::string& after_hash,
     std::optional<bool> archival,
     multiclient::SessionPtr session
+) const {
+  TransactionPage transactions;
+  transactions.reserve(count);
+  auto [r_txs, new_session] = streamBlockTransactionsExt(
+      workchain, shard, seqno, count, root_hash, file_hash, after_lt, after_hash, archival,
+      [&transactions](TransactionPage&& page) {
+        std::move(page.begin(), page.end(), std::back_inserter(transactions));
+      },
+      session
+  );
+  if (r_txs.is_ok()) {
+    r_txs.ok_ref()->transactions_ = std::move(transactions);
+  }
+  return {std::move(r_txs), new_session};
+}
+TonlibWorker::Result<tonlib_api::blocks_getTransactionsExt::ReturnType> TonlibWorker::streamBlockTransactionsExt(
+    const ton::WorkchainId& workchain,
+    const ton::ShardId& shard,
+    const ton::BlockSeqno& seqno,
+    const size_t count,
+    const std::string& root_hash,
+    const std::string& file_hash,
+    const std::optional<ton::LogicalTime>& after_lt,
+    const std::string& after_hash,
+    std::optional<bool> archival,
+    const TransactionPageCallback& on_page,
+    multiclient::SessionPtr session
 ) const {
   if (session == nullptr && archival.has_value()) {
     auto options = multiclient::RequestParameters{.mode = multiclient::RequestMode::Single, .archival = archival};
@@ -939,6 +1379,19 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactionsExt::ReturnType> TonlibWo
     session = std::move(new_session);
   }
 
+  // a whole block from the start is scanned in parallel ranges
+  if (!after_lt.has_value() && count > kBlockScanChunkSize) {
+    return scanBlockTransactions<tonlib_api::blocks_transactionsExt>(
+        blk_id, count, archival, session, &TonlibWorker::raw_getBlockTransactionsExt,
+        [](const tonlib_api::raw_transaction& tx) {
+          auto r_std_address = block::StdAddress::parse(tx.address_->account_address_);
+          auto account = r_std_address.is_ok() ? r_std_address.ok().addr.as_slice().str() : std::string();
+          return std::make_pair(std::move(account), tx.transaction_id_->lt_);
+        },
+        on_page
+    );
+  }
+
   tonlib_api::object_ptr<tonlib_api::blocks_accountTransactionId> after;
   if (after_lt.has_value()) {
     after = tonlib_api::make_object<tonlib_api::blocks_accountTransactionId>(after_hash, after_lt.value());
@@ -950,13 +1403,12 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactionsExt::ReturnType> TonlibWo
 
   size_t left_count = count;
   bool is_finished = false;
-  constexpr size_t CHUNK_SIZE = 256;
+  constexpr size_t CHUNK_SIZE = kBlockScanChunkSize;
 
   tonlib_api::object_ptr<tonlib_api::blocks_transactionsExt> txs =
       tonlib_api::make_object<tonlib_api::blocks_transactionsExt>(
           nullptr, 0, true, std::move(std::vector<tonlib_api::object_ptr<tonlib_api::raw_transaction>>{})
       );
-  txs->transactions_.reserve(count);
   while (!is_finished) {
     size_t chunk_size = (left_count > CHUNK_SIZE ? CHUNK_SIZE : left_count);
     auto [result, new_session] = raw_getBlockTransactionsExt(blk_id, chunk_size, std::move(after), archival, session);
@@ -980,12 +1432,8 @@ TonlibWorker::Result<tonlib_api::blocks_getTransactionsExt::ReturnType> TonlibWo
       );
     }
 
-    std::copy(
-        std::make_move_iterator(local->transactions_.begin()),
-        std::make_move_iterator(local->transactions_.end()),
-        std::back_inserter(txs->transactions_)
-    );
     is_finished = (left_count <= 0) || !local->incomplete_;
+    on_page(std::move(local->transactions_));
   }
   txs->req_count_ = static_cast<std::int32_t>(count);
   return {std::move(txs), session};
@@ -1000,6 +1448,32 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
     bool try_decode_messages,
     std::optional<bool> archival,
     multiclient::SessionPtr session
+) const {
+  TransactionPage transactions;
+  auto [r_txs, new_session] = streamTransactions(
+      account_address, from_transaction_lt, std::move(from_transaction_hash), to_transaction_lt, count, chunk_size,
+      try_decode_messages, archival,
+      [&transactions](TransactionPage&& page) {
+        std::move(page.begin(), page.end(), std::back_inserter(transactions));
+      },
+      session
+  );
+  if (r_txs.is_ok()) {
+    r_txs.ok_ref()->transactions_ = std::move(transactions);
+  }
+  return {std::move(r_txs), new_session};
+}
+TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker::streamTransactions(
+    const std::string& account_address,
+    std::optional<ton::LogicalTime> from_transaction_lt,
+    std::string from_transaction_hash,
+    ton::LogicalTime to_transaction_lt,
+    size_t count,
+    size_t chunk_size,
+    bool try_decode_messages,
+    std::optional<bool> archival,
+    const TransactionPageCallback& on_page,
+    multiclient::SessionPtr session
 ) const {
   if (session == nullptr && archival.has_value()) {
     auto options = multiclient::RequestParameters{.mode = multiclient::RequestMode::Single, .archival = archival};
@@ -1020,23 +1494,78 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
     from_transaction_hash = account_state_->last_transaction_id_->hash_;
   }
 
+  static constexpr size_t kMaxChunksInFlight = 4;
+  using ChunkTask = userver::engine::TaskWithResult<Result<tonlib_api::raw_getTransactionsV2::ReturnType>>;
+  struct Chunk {
+    TransactionId start;
+    ChunkTask task;
+  };
+
+  const auto account_key = transaction_index_account(account_address);
+  const auto is_history_end = [to_transaction_lt](const TransactionId& tx_id) {
+    return tx_id.lt == 0 || tx_id.lt <= to_transaction_lt;
+  };
+
+  // chunks are requested ahead as far as the start of the next one is known: either from cached chain links
+  // or, once the links run out, from previous_transaction_id_ of the last requested chunk
+  std::deque<Chunk> chunks;
+  std::optional<TransactionId> next_start = TransactionId{from_transaction_lt.value(), from_transaction_hash};
+  size_t requested_count = 0;
+  const auto request_chunks = [&] {
+    while (next_start.has_value() && chunks.size() < kMaxChunksInFlight && requested_count < count
+           && !is_history_end(next_start.value())) {
+      const size_t local_chunk_size = std::min(chunk_size, count - requested_count);
+      auto start = std::move(next_start.value());
+      auto chunk_session = session ? std::make_shared<multiclient::Session>(*session) : nullptr;
+      auto task = userver::utils::Async(
+          "gettransactions_chunk",
+          [this, &account_address, start, local_chunk_size, try_decode_messages, archival, chunk_session] {
+            return raw_getTransactionsV2(
+                account_address, start.lt, start.hash, local_chunk_size, try_decode_messages, archival, chunk_session
+            );
+          }
+      );
+      next_start = tx_index_->Skip(account_key, start, local_chunk_size);
+      chunks.push_back(Chunk{std::move(start), std::move(task)});
+      requested_count += local_chunk_size;
+    }
+  };
+
   bool reach_lt = false;
   size_t tx_count = 0;
-  auto current_lt = from_transaction_lt.value();
-  auto current_hash = from_transaction_hash;
-
   tonlib_api::object_ptr<tonlib_api::raw_transactions> txs = tonlib_api::make_object<tonlib_api::raw_transactions>();
-  while (!reach_lt && tx_count < count) {
-    size_t local_chunk_size = (count - tx_count > chunk_size ? chunk_size : count - tx_count);
-    auto [r_local, new_session] = raw_getTransactionsV2(
-        account_address, current_lt, current_hash, local_chunk_size, try_decode_messages, archival, session
-    );
+  request_chunks();
+  while (!reach_lt && tx_count < count && !chunks.empty()) {
+    auto chunk = std::move(chunks.front());
+    chunks.pop_front();
+    auto [r_local, new_session] = chunk.task.Get();
     if (r_local.is_error()) {
       return {r_local.move_as_error(), new_session};
     }
     auto local = r_local.move_as_ok();
     session = std::move(new_session);
 
+    // it seems that previous_transaction_id_ is always not nullptr, however I'll leave it as it was in Python version
+    std::optional<TransactionId> previous;
+    if (auto& next_tx = local->previous_transaction_id_; next_tx) {
+      previous = TransactionId{next_tx->lt_, next_tx->hash_};
+    }
+    // the liteserver may return less than requested, then the chunks requested ahead don't continue this one
+    if (!chunks.empty()) {
+      const auto& expected = chunks.front().start;
+      if (!previous.has_value() || expected.lt != previous->lt || expected.hash != previous->hash) {
+        chunks.clear();
+      }
+    }
+    if (chunks.empty()) {
+      next_start = previous;
+      requested_count = tx_count + local->transactions_.size();
+    }
+    // the next chunk is requested before this one is processed
+    request_chunks();
+
+    // transactions are ordered by lt, so the ones at or below to_transaction_lt are the tail of the chunk
+    const size_t passed_count = tx_count;
     for (auto& tx : local->transactions_) {
       if (tx->transaction_id_->lt_ <= to_transaction_lt) {
         reach_lt = true;
@@ -1044,31 +1573,174 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
         ++tx_count;
       }
     }
-
-    // it seems that previous_transaction_id_ is always not nullptr, however I'll leave it as it was in Python version
-    if (auto& next_tx = local->previous_transaction_id_; next_tx) {
-      current_lt = next_tx->lt_;
-      current_hash = next_tx->hash_;
-    } else {
-      reach_lt = true;
-    }
-    if (current_lt == 0) {
+    if (!previous.has_value() || previous->lt == 0) {
       reach_lt = true;
     }
-    std::copy(
-        std::move_iterator(local->transactions_.begin()),
-        std::move_iterator(local->transactions_.end()),
-        std::back_inserter(txs->transactions_)
-    );
+    tx_count = std::min(tx_count, count);
+    local->transactions_.resize(tx_count - passed_count);
+    on_page(std::move(local->transactions_));
     if (local->previous_transaction_id_) {
       txs->previous_transaction_id_ = std::move(local->previous_transaction_id_);
     }
   }
-  if (txs->transactions_.size() > tx_count) {
-    txs->transactions_.resize(tx_count);
-  }
   return {std::move(txs), session};
 }
+// tryLocate* responses hold the found transaction alone, without a link to the previous one
+static tonlib_api::object_ptr<tonlib_api::raw_transactions> located_transaction(
+    tonlib_api::object_ptr<tonlib_api::raw_transaction>&& tx
+) {
+  std::vector<tonlib_api::object_ptr<tonlib_api::raw_transaction>> tx_vec;
+  tx_vec.emplace_back(std::move(tx));
+  auto prev_tx = tonlib_api::make_object<tonlib_api::internal_transactionId>(
+      0, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA="
+  );
+  return tonlib_api::make_object<tonlib_api::raw_transactions>(std::move(tx_vec), std::move(prev_tx));
+}
+
+TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker::getLocatedTransaction(
+    const MessageIndex::Location& location,
+    multiclient::SessionPtr session
+) const {
+  auto [r_txs, new_session] = raw_getTransactionsV2(
+      location.account, location.transaction_id.lt, location.transaction_id.hash, 1, true, std::nullopt, session
+  );
+  if (r_txs.is_error()) {
+    return {r_txs.move_as_error(), new_session};
+  }
+  auto txs = r_txs.move_as_ok();
+  if (txs->transactions_.empty()) {
+    return {td::Status::Error(404, "indexed transaction was not found"), new_session};
+  }
+  return {located_transaction(std::move(txs->transactions_.front())), new_session};
+}
+
+template <typename Match>
+TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker::locateTransaction(
+    const block::StdAddress& account,
+    const std::string& account_address,
+    ton::LogicalTime created_lt,
+    size_t lt_probes,
+    multiclient::SessionPtr session,
+    Match match
+) const {
+  using ProbeResult = td::Result<tonlib_api::object_ptr<tonlib_api::raw_transaction>>;
+  static constexpr ton::LogicalTime kLocateLtStep = 1000000;
+  static constexpr size_t kLocateBlockTxCount = 40;
+  static constexpr size_t kLocateMinTxCount = 10;
+
+  auto [r_shards, new_session] = getShards(std::nullopt, created_lt, std::nullopt, session);
+  session = std::move(new_session);
+  if (r_shards.is_error()) {
+    return {r_shards.move_as_error_prefix("failed to get shards at create_lt: "), session};
+  }
+  auto shards = r_shards.move_as_ok();
+
+  // only shards containing the account can hold its transactions
+  const auto account_bytes = account.addr.as_slice();
+  const auto prefix = account_prefix(account_bytes);
+  std::vector<ton::ShardId> shard_ids;
+  if (account.workchain == ton::masterchainId) {
+    shard_ids.push_back(ton::shardIdAll);
+  }
+  for (const auto& shard : shards->shards_) {
+    const auto shard_id = static_cast<std::uint64_t>(shard->shard_);
+    const auto shard_lowbit = shard_id & (~shard_id + 1);
+    const auto prefix_mask = ~((shard_lowbit << 1) - 1);
+    if (shard->workchain_ == account.workchain && ((prefix ^ shard_id) & prefix_mask) == 0) {
+      shard_ids.push_back(shard->shard_);
+    }
+  }
+
+  // a probe checks the history of the account starting from its last transaction in the block at lt
+  auto probe = [&](ton::ShardId shard_id, ton::LogicalTime lt) -> ProbeResult {
+    auto [r_block, probe_session] = lookupBlock(account.workchain, shard_id, std::nullopt, lt, std::nullopt, nullptr);
+    if (r_block.is_error()) {
+      td::StringBuilder sb;
+      sb << "failed to lookup block with lt " << lt << ": ";
+      return r_block.move_as_error_prefix(sb.as_cslice().str());
+    }
+    auto block = r_block.move_as_ok();
+
+    auto [r_txs, new_probe_session] = getBlockTransactions(
+        block->workchain_, block->shard_, block->seqno_, kLocateBlockTxCount, block->root_hash_, block->file_hash_,
+        std::nullopt, "", std::nullopt, probe_session
+    );
+    if (r_txs.is_error()) {
+      td::StringBuilder sb;
+      sb << "failed to get transactions for block (" << block->workchain_ << ", " << block->shard_ << ", "
+         << block->seqno_ << "): ";
+      return r_txs.move_as_error_prefix(sb.as_cslice().str());
+    }
+    auto blk_txs = r_txs.move_as_ok();
+    probe_session = std::move(new_probe_session);
+
+    tonlib_api::object_ptr<tonlib_api::blocks_shortTxId> candidate = nullptr;
+    size_t tx_found = 0;
+    for (auto& tx : blk_txs->transactions_) {
+      if (td::Slice(tx->account_) != account_bytes) {
+        continue;
+      }
+      ++tx_found;
+      if (candidate == nullptr || candidate->lt_ < tx->lt_) {
+        candidate = std::move(tx);
+      }
+    }
+    if (candidate == nullptr) {
+      return nullptr;
+    }
+
+    auto [r_candidate_txs, _] = getTransactions(
+        account_address, candidate->lt_, candidate->hash_, 0, std::max(tx_found, kLocateMinTxCount), 30, true,
+        std::nullopt, probe_session
+    );
+    if (r_candidate_txs.is_error()) {
+      return r_candidate_txs.move_as_error_prefix("failed to get candidate transactions: ");
+    }
+    auto candidate_txs = r_candidate_txs.move_as_ok();
+    for (auto& candidate_tx : candidate_txs->transactions_) {
+      if (match(*candidate_tx)) {
+        return std::move(candidate_tx);
+      }
+    }
+    return nullptr;
+  };
+
+  // every probe picks its own worker, the first match cancels the rest
+  std::vector<userver::engine::TaskWithResult<ProbeResult>> tasks;
+  tasks.reserve(shard_ids.size() * lt_probes);
+  for (auto shard_id : shard_ids) {
+    for (size_t i = 0; i < lt_probes; ++i) {
+      tasks.push_back(userver::utils::Async("locate_tx_probe", [&probe, shard_id, lt = created_lt + kLocateLtStep * i] {
+        return probe(shard_id, lt);
+      }));
+    }
+  }
+
+  std::optional<td::Status> first_error;
+  while (!tasks.empty()) {
+    auto task_idx = userver::engine::WaitAny(tasks);
+    if (!task_idx.has_value()) {
+      return {td::Status::Error("transaction lookup was cancelled"), session};
+    }
+    auto r_tx = tasks[task_idx.value()].Get();
+    tasks.erase(tasks.begin() + static_cast<std::ptrdiff_t>(task_idx.value()));
+    if (r_tx.is_error()) {
+      if (!first_error.has_value()) {
+        first_error = r_tx.move_as_error();
+      }
+      continue;
+    }
+    auto tx = r_tx.move_as_ok();
+    if (tx != nullptr) {
+      tasks.clear();
+      return {located_transaction(std::move(tx)), session};
+    }
+  }
+  if (first_error.has_value()) {
+    return {std::move(first_error.value()), session};
+  }
+  return {td::Status::Error(404, "transaction was not found"), session};
+}
 
 TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker::tryLocateTransactionByIncomingMessage(
     const std::string& source,
@@ -1088,75 +1760,25 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
   }
   auto dest = r_dest_addr.move_as_ok();
 
-  auto workchain = dest.workchain;
-  auto [r_shards, new_session] = getShards(std::nullopt, created_lt, std::nullopt, session);
-  if (r_shards.is_error()) {
-    return {r_shards.move_as_error_prefix("failed to get shards at create_lt: "), new_session};
-  }
-  auto shards = r_shards.move_as_ok();
-  for (auto& shard : shards->shards_) {
-    auto shard_id = shard->shard_;
-    for (auto i = 0; i < 3; ++i) {
-      auto lt = created_lt + 1000000 * i;
-      auto [r_block, new_session] = lookupBlock(workchain, shard_id, std::nullopt, lt, std::nullopt, session);
-      if (r_block.is_error()) {
-        td::StringBuilder sb;
-        sb << "failed to lookup block with lt " << lt << ": ";
-        return {r_block.move_as_error_prefix(sb.as_cslice().str()), new_session};
-      }
-      auto block = r_block.move_as_ok();
-      session = std::move(new_session);
-
-      constexpr size_t tx_count = 40;
-      auto [r_txs, new_session_2] = getBlockTransactions(
-          block->workchain_, block->shard_, block->seqno_, tx_count, block->root_hash_, block->file_hash_, 40, "", std::nullopt, session
-      );
-      if (r_txs.is_error()) {
-        td::StringBuilder sb;
-        sb << "failed to get transactions for block (" << block->workchain_ << ", " << block->shard_ << ", "
-           << block->seqno_ << "): ";
-        return {r_txs.move_as_error_prefix(sb.as_cslice().str()), new_session_2};
-      }
-      auto blk_txs = r_txs.move_as_ok();
-      session = std::move(new_session_2);
-
-      tonlib_api::object_ptr<tonlib_api::blocks_shortTxId> candidate = nullptr;
-      size_t tx_found = 0;
-      for (auto& tx : blk_txs->transactions_) {
-        auto tx_addr_str = std::to_string(block->workchain_) + ":" + td::hex_encode(tx->account_);
-        auto tx_addr = block::StdAddress::parse(tx_addr_str).move_as_ok();
-        if (dest.addr == tx_addr.addr && (candidate == nullptr || candidate->lt_ < tx->lt_)) {
-          ++tx_found;
-          candidate = std::move(tx);
-        }
-      }
-      if (candidate != nullptr) {
-        constexpr size_t min_tx_found = 10;
-        auto [r_candidate_txs, new_session] =
-            getTransactions(destination, candidate->lt_, candidate->hash_, std::max(tx_found, min_tx_found), 10, 30, true, std::nullopt, session);
-        if (r_txs.is_error()) {
-          return {r_txs.move_as_error_prefix("failed to get candidate transactions: "), new_session};
-        }
-        auto candidate_txs = r_candidate_txs.move_as_ok();
-        session = std::move(new_session);
-        for (auto & candidate_tx : candidate_txs->transactions_) {
-          auto& in_msg = candidate_tx->in_msg_;
-          if (in_msg && in_msg->source_ && !in_msg->source_->account_address_.empty()) {
-            auto tx_src_addr = block::StdAddress::parse(in_msg->source_->account_address_).move_as_ok();
-            if (src.workchain == tx_src_addr.workchain && src.addr == tx_src_addr.addr && in_msg->created_lt_ == created_lt) {
-              std::vector<tonlib_api::object_ptr<tonlib_api::raw_transaction>> tx_vec;
-              tx_vec.emplace_back(std::move(candidate_tx));
-              auto prev_tx = tonlib_api::make_object<tonlib_api::internal_transactionId>(
-                0, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA="
-              );
-              return {tonlib_api::make_object<tonlib_api::raw_transactions>(std::move(tx_vec), std::move(prev_tx)), session};
-            }
-          }
-        }
+  if (msg_index_) {
+    if (auto location = msg_index_->FindDestination(src, dest, created_lt); location.has_value()) {
+      auto [r_txs, new_session] = getLocatedTransaction(location.value(), session);
+      if (r_txs.is_ok()) {
+        return {r_txs.move_as_ok(), new_session};
       }
+      LOG(WARNING) << "Failed to get indexed transaction: " << r_txs.error();
     }
   }
-  return {td::Status::Error(404, "transaction was not found"), session};
+
+  // the message may be delivered a few blocks later, so the blocks ahead of created_lt are probed as well
+  return locateTransaction(dest, destination, created_lt, 3, session, [&](const tonlib_api::raw_transaction& tx) {
+    auto& in_msg = tx.in_msg_;
+    if (!in_msg || in_msg->created_lt_ != created_lt || !in_msg->source_ || in_msg->source_->account_address_.empty()) {
+      return false;
+    }
+    auto r_tx_src_addr = block::StdAddress::parse(in_msg->source_->account_address_);
+    return r_tx_src_addr.is_ok() && src.workchain == r_tx_src_addr.ok().workchain && src.addr == r_tx_src_addr.ok().addr;
+  });
 }
 
 TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker::tryLocateTransactionByOutgoingMessage(
@@ -1177,75 +1799,131 @@ TonlibWorker::Result<tonlib_api::raw_getTransactionsV2::ReturnType> TonlibWorker
   }
   auto dest = r_dest_addr.move_as_ok();
 
-  auto workchain = src.workchain;
-  auto [r_shards, new_session] = getShards(std::nullopt, created_lt, std::nullopt, session);
-  session = std::move(new_session);
-  if (r_shards.is_error()) {
-    return {r_shards.move_as_error_prefix("failed to get shards at create_lt: "), session};
+  if (msg_index_) {
+    if (auto location = msg_index_->FindSource(src, dest, created_lt); location.has_value()) {
+      auto [r_txs, new_session] = getLocatedTransaction(location.value(), session);
+      if (r_txs.is_ok()) {
+        return {r_txs.move_as_ok(), new_session};
+      }
+      LOG(WARNING) << "Failed to get indexed transaction: " << r_txs.error();
+    }
   }
-  auto shards = r_shards.move_as_ok();
-  for (auto& shard : shards->shards_) {
-    auto shard_id = shard->shard_;
-    auto [r_block, new_session] = lookupBlock(workchain, shard_id, std::nullopt, created_lt, std::nullopt, session);
-    session = std::move(new_session);
-    if (r_block.is_error()) {
-      td::StringBuilder sb;
-      sb << "failed to lookup block with lt " << created_lt << ": ";
-      return {r_block.move_as_error_prefix(sb.as_cslice().str()), session};
+
+  return locateTransaction(src, source, created_lt, 1, session, [&](const tonlib_api::raw_transaction& tx) {
+    for (const auto& out_msg : tx.out_msgs_) {
+      if (!out_msg || out_msg->created_lt_ != created_lt || !out_msg->destination_ ||
+          out_msg->destination_->account_address_.empty()) {
+        continue;
+      }
+      auto r_tx_dest_addr = block::StdAddress::parse(out_msg->destination_->account_address_);
+      if (r_tx_dest_addr.is_ok() && dest.workchain == r_tx_dest_addr.ok().workchain &&
+          dest.addr == r_tx_dest_addr.ok().addr) {
+        return true;
+      }
     }
-    auto block = r_block.move_as_ok();
+    return false;
+  });
+}
 
-    constexpr size_t tx_count = 40;
-    auto [r_txs, new_session_2] = getBlockTransactions(
-        block->workchain_, block->shard_, block->seqno_, tx_count, block->root_hash_, block->file_hash_, std::nullopt, "", std::nullopt, session
-    );
-    session = std::move(new_session_2);
-    if (r_txs.is_error()) {
-      td::StringBuilder sb;
-      sb << "failed to get transactions for block (" << block->workchain_ << ", " << block->shard_ << ", "
-         << block->seqno_ << "): ";
-      return {r_txs.move_as_error_prefix(sb.as_cslice().str()), session};
+td::Status TonlibWorker::indexNewBlocks() const {
+  // blocks behind a long stall are not worth catching up with, the window would drop them soon anyway
+  static constexpr ton::BlockSeqno kMaxMasterchainBlocksPerRun = 16;
+  if (!msg_index_) {
+    return td::Status::OK();
+  }
+
+  auto [r_mc_info, _] = getMasterchainInfo(nullptr);
+  if (r_mc_info.is_error()) {
+    return r_mc_info.move_as_error_prefix("failed to get masterchain info: ");
+  }
+  auto last_seqno = static_cast<ton::BlockSeqno>(r_mc_info.ok()->last_->seqno_);
+  auto from_seqno = indexed_mc_seqno_.has_value() ? indexed_mc_seqno_.value() + 1 : last_seqno;
+  if (last_seqno - std::min(from_seqno, last_seqno) >= kMaxMasterchainBlocksPerRun) {
+    LOG(WARNING) << "Message index skips masterchain blocks " << from_seqno << ".."
+                 << last_seqno - kMaxMasterchainBlocksPerRun;
+    from_seqno = last_seqno - kMaxMasterchainBlocksPerRun + 1;
+  }
+  for (auto mc_seqno = from_seqno; mc_seqno <= last_seqno; ++mc_seqno) {
+    auto status = indexMasterchainBlock(mc_seqno);
+    if (status.is_error()) {
+      return status;
     }
-    auto blk_txs = r_txs.move_as_ok();
+    indexed_mc_seqno_ = mc_seqno;
+  }
+  return td::Status::OK();
+}
 
-    tonlib_api::object_ptr<tonlib_api::blocks_shortTxId> candidate = nullptr;
-    size_t tx_found = 0;
-    for (auto& tx : blk_txs->transactions_) {
-      auto tx_addr_str = std::to_string(block->workchain_) + ":" + td::hex_encode(tx->account_);
-      auto tx_addr = block::StdAddress::parse(tx_addr_str).move_as_ok();
-      if (src.addr == tx_addr.addr && (candidate == nullptr || candidate->lt_ < tx->lt_)) {
-        ++tx_found;
-        candidate = std::move(tx);
-      }
+td::Status TonlibWorker::indexMasterchainBlock(ton::BlockSeqno mc_seqno) const {
+  static constexpr ton::BlockSeqno kMaxShardBlocksPerRun = 16;
+  // no limit, the whole block is paged through
+  static constexpr size_t kIndexBlockTxCount = std::numeric_limits<std::int32_t>::max();
+
+  auto [r_mc_block, session] = lookupBlock(ton::masterchainId, ton::shardIdAll, mc_seqno, std::nullopt, std::nullopt, nullptr);
+  if (r_mc_block.is_error()) {
+    return r_mc_block.move_as_error_prefix("failed to lookup masterchain block: ");
+  }
+  auto [r_shards, new_session] = getShards(mc_seqno, std::nullopt, std::nullopt, session);
+  if (r_shards.is_error()) {
+    return r_shards.move_as_error_prefix("failed to get shards: ");
+  }
+  auto shards = r_shards.move_as_ok();
+
+  std::vector<tonlib_api::object_ptr<tonlib_api::ton_blockIdExt>> blocks;
+  blocks.push_back(r_mc_block.move_as_ok());
+  // shard blocks between the previous and the current top are looked up by seqno,
+  // a shard that appeared after split or merge starts from its top block
+  std::map<std::pair<ton::WorkchainId, ton::ShardId>, ton::BlockSeqno> shard_seqnos;
+  for (auto& shard : shards->shards_) {
+    auto top_seqno = static_cast<ton::BlockSeqno>(shard->seqno_);
+    auto shard_key = std::pair<ton::WorkchainId, ton::ShardId>{shard->workchain_, static_cast<ton::ShardId>(shard->shard_)};
+    shard_seqnos[shard_key] = top_seqno;
+    auto it = indexed_shard_seqnos_.find(shard_key);
+    if (it != indexed_shard_seqnos_.end() && it->second >= top_seqno) {
+      continue;
     }
-    if (candidate != nullptr) {
-      constexpr size_t min_tx_found = 10;
-      auto [r_candidate_txs, new_session] =
-          getTransactions(source, candidate->lt_, candidate->hash_, std::max(tx_found, min_tx_found), 10, 30, true, std::nullopt, session);
-      session = std::move(new_session);
-      if (r_txs.is_error()) {
-        return {r_txs.move_as_error_prefix("failed to get candidate transactions: "), session};
+    auto from_seqno = it != indexed_shard_seqnos_.end() ? it->second + 1 : top_seqno;
+    from_seqno = std::max(from_seqno, top_seqno - std::min(top_seqno, kMaxShardBlocksPerRun - 1));
+    for (auto seqno = from_seqno; seqno < top_seqno; ++seqno) {
+      auto [r_block, _] = lookupBlock(shard->workchain_, shard->shard_, seqno, std::nullopt, std::nullopt, new_session);
+      if (r_block.is_error()) {
+        return r_block.move_as_error_prefix("failed to lookup shard block: ");
       }
-      auto candidate_txs = r_candidate_txs.move_as_ok();
-      for (auto& candidate_tx : candidate_txs->transactions_) {
-        for (auto& out_msg : candidate_tx->out_msgs_) {
-          if (out_msg && out_msg->destination_ && !out_msg->destination_->account_address_.empty()) {
-            auto tx_dest_addr = block::StdAddress::parse(out_msg->destination_->account_address_).move_as_ok();
-            if (dest.workchain == tx_dest_addr.workchain && dest.addr == tx_dest_addr.addr &&
-                out_msg->created_lt_ == created_lt) {
-              std::vector<tonlib_api::object_ptr<tonlib_api::raw_transaction>> tx_vec;
-              tx_vec.emplace_back(std::move(candidate_tx));
-              auto prev_tx = tonlib_api::make_object<tonlib_api::internal_transactionId>(
-                  0, "AAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA="
-              );
-              return {tonlib_api::make_object<tonlib_api::raw_transactions>(std::move(tx_vec), std::move(prev_tx)), session};
-            }
-          }
+      blocks.push_back(r_block.move_as_ok());
+    }
+    blocks.push_back(std::move(shard));
+  }
+
+  std::vector<userver::engine::TaskWithResult<td::Status>> tasks;
+  tasks.reserve(blocks.size());
+  for (const auto& block : blocks) {
+    tasks.push_back(userver::utils::Async("message_index_block", [this, &block]() -> td::Status {
+      // pages are indexed as they come, so a busy block is not held in memory as a whole
+      TransactionPageCallback on_page = [this](TransactionPage&& page) {
+        for (const auto& tx : page) {
+          msg_index_->Remember(*tx);
         }
+      };
+      auto [r_txs, _] = streamBlockTransactionsExt(
+          block->workchain_, block->shard_, block->seqno_, kIndexBlockTxCount, block->root_hash_, block->file_hash_,
+          std::nullopt, "", std::nullopt, on_page, nullptr
+      );
+      if (r_txs.is_error()) {
+        td::StringBuilder sb;
+        sb << "failed to get transactions for block (" << block->workchain_ << ", " << block->shard_ << ", "
+           << block->seqno_ << "): ";
+        return r_txs.move_as_error_prefix(sb.as_cslice().str());
       }
+      return td::Status::OK();
+    }));
+  }
+  for (auto& task : tasks) {
+    auto status = task.Get();
+    if (status.is_error()) {
+      return status;
     }
   }
-  return {td::Status::Error(404, "transaction was not found"), session};
+  indexed_shard_seqnos_ = std::move(shard_seqnos);
+  return td::Status::OK();
 }
 
 TonlibWorker::Result<tonlib_api::raw_sendMessage::ReturnType> TonlibWorker::raw_sendMessage(
@@ -1363,66 +2041,248 @@ TonlibWorker::Result<std::unique_ptr<tonlib_api::ok>> TonlibWorker::forgetContra
   auto [result, new_session] = send_request_function(std::move(request), true);
   return {std::move(result), std::move(new_session)};
 }
-TonlibWorker::Result<RunGetMethodResult> TonlibWorker::runGetMethod(
+std::optional<ContractCache::Key> TonlibWorker::contractCacheKey(
+    const std::string& address, std::optional<ton::BlockSeqno> seqno
+) const {
+  if (!contract_cache_.IsEnabled()) {
+    return std::nullopt;
+  }
+  auto r_std_address = block::StdAddress::parse(address);
+  if (r_std_address.is_error()) {
+    return std::nullopt;
+  }
+  auto raw_address = DetectAddressResult{r_std_address.move_as_ok(), ""}.to_raw_form(true);
+  if (seqno.has_value()) {
+    return ContractCache::Key{std::move(raw_address), seqno.value(), false};
+  }
+  // the latest state is reused only while the consensus block stays the same
+  const auto consensus_block = getLastConsensusBlock();
+  if (consensus_block <= 0) {
+    return std::nullopt;
+  }
+  return ContractCache::Key{std::move(raw_address), static_cast<ton::BlockSeqno>(consensus_block), true};
+}
+TonlibWorker::Result<ContractHandlePtr> TonlibWorker::acquireContract(
     const std::string& address,
-    const std::string& method_name,
-    const std::vector<std::string>& stack,
     std::optional<ton::BlockSeqno> seqno,
     std::optional<bool> archival,
-    multiclient::SessionPtr session
+    multiclient::SessionPtr session,
+    bool force_reload
 ) const {
+  auto key = contractCacheKey(address, seqno);
+  if (key.has_value() && !force_reload) {
+    if (auto handle = contract_cache_.Get(key.value(), session)) {
+      if (!session) {
+        session = std::make_shared<multiclient::Session>(*handle->session);
+      }
+      return {std::move(handle), std::move(session)};
+    }
+  }
+
   auto [r_smc_info, new_session] = loadContract(address, seqno, archival, session);
   session = std::move(new_session);
   if (!r_smc_info.is_ok()) {
     return {r_smc_info.move_as_error(), session};
   }
-  auto smc_info = r_smc_info.move_as_ok();
+  auto handle = std::make_shared<const ContractHandle>(
+      ContractHandle{r_smc_info.move_as_ok()->id_, std::make_shared<multiclient::Session>(*session)}
+  );
+  // the id is bound to a single tonlib client, so only handles of a pinned session can be shared
+  if (key.has_value() && session->active_workers().size() == 1) {
+    contract_cache_.Put(key.value(), handle);
+  } else {
+    contract_cache_.Retire(handle);
+  }
+  return {std::move(handle), std::move(session)};
+}
+void TonlibWorker::invalidateLostContract(
+    const std::string& address,
+    std::optional<ton::BlockSeqno> seqno,
+    const ContractHandlePtr& handle,
+    const td::Status& error
+) const {
+  if (!is_lost_contract_error(error)) {
+    return;
+  }
+  if (auto key = contractCacheKey(address, seqno); key.has_value()) {
+    contract_cache_.Invalidate(key.value(), handle);
+  }
+}
+void TonlibWorker::releaseContract(ContractHandlePtr&& handle) const {
+  handle.reset();
+  for (auto& released : contract_cache_.TakeReleased()) {
+    auto [forget_result, _] = forgetContract(released->id, std::nullopt, released->session);
+    if (forget_result.is_error()) {
+      LOG(WARNING) << "Failed to forget contract " << released->id << ": " << forget_result.move_as_error();
+    }
+  }
+}
+
+tonlib_api::object_ptr<tonlib_api::smc_runGetMethod> TonlibWorker::PreparedGetMethod::make_request(
+    std::int64_t smc_id
+) const {
+  if (method_number.has_value()) {
+    return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(
+        smc_id, tonlib_api::make_object<tonlib_api::smc_methodIdNumber>(method_number.value()), utils::clone_stack(stack)
+    );
+  }
+  return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(
+      smc_id, tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_name), utils::clone_stack(stack)
+  );
+}
+
+td::Result<TonlibWorker::PreparedGetMethodPtr> TonlibWorker::prepareGetMethod(
+    const std::string& method_name,
+    const std::vector<std::string>& stack
+) const {
+  std::string key = method_name;
+  for (const auto& item : stack) {
+    key += '\0' + std::to_string(item.size()) + ':' + item;
+  }
+  {
+    std::lock_guard lock(prepared_get_method_cache_mutex_);
+    if (const auto* prepared = prepared_get_method_cache_.Get(key)) {
+      return *prepared;
+    }
+  }
+
   auto r_stack = utils::parse_stack(stack);
   if (r_stack.is_error()) {
-    return {r_stack.move_as_error(), session};
+    return r_stack.move_as_error();
   }
-  auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
-    .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator =
-        [id_ = smc_info->id_, method_name_ = method_name, stack_str = stack] {
-          auto method_int = td::string_to_int256(method_name_);
-          auto stack = utils::parse_stack(stack_str).move_as_ok();
-          if (method_int.is_null()) {
-            return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(
-                id_, tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_name_), std::move(stack)
-            );
-          }
-          return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(
-              id_, tonlib_api::make_object<tonlib_api::smc_methodIdNumber>(method_int->to_long()), std::move(stack)
-          );
-    },
-  .session = session
-  };
-  auto [result, new_session_2] = send_request_function(std::move(request), false);
-  session = std::move(new_session_2);
-  if (result.is_error()) {
-    return {result.move_as_error(), session};
+  auto prepared = std::make_shared<PreparedGetMethod>();
+  prepared->method_name = method_name;
+  if (auto method_int = td::string_to_int256(method_name); method_int.not_null()) {
+    prepared->method_number = method_int->to_long();
   }
+  prepared->stack = r_stack.move_as_ok();
 
-  auto state_request = multiclient::RequestFunction<tonlib_api::smc_getRawFullAccountState>{
-    .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator =
-        [id_ = smc_info->id_] { return tonlib_api::make_object<tonlib_api::smc_getRawFullAccountState>(id_); },
+  std::lock_guard lock(prepared_get_method_cache_mutex_);
+  prepared_get_method_cache_.Put(key, prepared);
+  return prepared;
+}
+
+TonlibWorker::Result<RunGetMethodResult> TonlibWorker::runGetMethod(
+    const std::string& address,
+    const std::string& method_name,
+    const std::vector<std::string>& stack,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    multiclient::SessionPtr session
+) const {
+  auto r_prepared = prepareGetMethod(method_name, stack);
+  if (r_prepared.is_error()) {
+    return {r_prepared.move_as_error(), session};
+  }
+  auto prepared = r_prepared.move_as_ok();
+
+  // a cached contract handle may have been lost by its worker, so such a call is retried once with a fresh load
+  const auto initial_session = session;
+  for (const bool force_reload : {false, true}) {
+    auto [r_handle, new_session] = acquireContract(address, seqno, archival, initial_session, force_reload);
+    session = std::move(new_session);
+    if (!r_handle.is_ok()) {
+      return {r_handle.move_as_error(), session};
+    }
+    auto handle = r_handle.move_as_ok();
+
+    auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
+      .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
+      .request_creator = [id_ = handle->id, prepared] { return prepared->make_request(id_); },
     .session = session
-};
-  auto [state_result, new_session_3] = send_request_function(std::move(state_request), false);
-  session = std::move(new_session_3);
-  if (state_result.is_error()) {
-    return {state_result.move_as_error(), session};
+    };
+    auto [result, new_session_2] = send_request_function(std::move(request), false);
+    session = std::move(new_session_2);
+    if (result.is_error()) {
+      invalidateLostContract(address, seqno, handle, result.error());
+      releaseContract(std::move(handle));
+      if (!force_reload && is_lost_contract_error(result.error())) {
+        LOG(DEBUG) << "runGetMethod on cached contract " << address << " failed: " << result.error();
+        continue;
+      }
+      return {result.move_as_error(), session};
+    }
+
+    auto state_request = multiclient::RequestFunction<tonlib_api::smc_getRawFullAccountState>{
+      .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
+      .request_creator =
+          [id_ = handle->id] { return tonlib_api::make_object<tonlib_api::smc_getRawFullAccountState>(id_); },
+      .session = session
+    };
+    auto [state_result, new_session_3] = send_request_function(std::move(state_request), false);
+    session = std::move(new_session_3);
+    releaseContract(std::move(handle));
+    if (state_result.is_error()) {
+      return {state_result.move_as_error(), session};
+    }
+
+    return {RunGetMethodResult{result.move_as_ok(), state_result.move_as_ok()}, session};
   }
+  UNREACHABLE();
+}
 
-  auto [forget_result, forget_session] = forgetContract(smc_info->id_, archival, session);
-  session = std::move(forget_session);
-  if (forget_result.is_error()) {
-    return {forget_result.move_as_error(), session};
+TonlibWorker::Result<std::vector<td::Result<RunGetMethodResult>>> TonlibWorker::runGetMethodBatch(
+    const std::vector<RunGetMethodBatchEntry>& entries,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    multiclient::SessionPtr session
+) const {
+  std::vector<td::Result<RunGetMethodResult>> results;
+  results.reserve(entries.size());
+  auto [r_seqno, new_session] = streamRunGetMethodBatch(
+      entries, seqno, archival, [&results](td::Result<RunGetMethodResult>&& result) {
+        results.push_back(std::move(result));
+      }, std::move(session)
+  );
+  if (r_seqno.is_error()) {
+    return {r_seqno.move_as_error(), new_session};
+  }
+  return {std::move(results), new_session};
+}
+
+TonlibWorker::Result<ton::BlockSeqno> TonlibWorker::streamRunGetMethodBatch(
+    const std::vector<RunGetMethodBatchEntry>& entries,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    const RunGetMethodResultCallback& on_result,
+    multiclient::SessionPtr session
+) const {
+  static constexpr std::size_t kMaxParallelCalls = 16;
+
+  // pin the batch to one masterchain block, further lookups of it are served from the block cache
+  if (seqno.has_value()) {
+    auto [r_blk_id, new_session] = lookupBlock(ton::masterchainId, ton::shardIdAll, seqno.value(), std::nullopt, std::nullopt, session);
+    session = std::move(new_session);
+    if (r_blk_id.is_error()) {
+      return {r_blk_id.move_as_error(), session};
+    }
+  } else {
+    auto [r_mc_info, new_session] = getMasterchainInfo(session);
+    session = std::move(new_session);
+    if (r_mc_info.is_error()) {
+      return {r_mc_info.move_as_error(), session};
+    }
+    auto mc_info = r_mc_info.move_as_ok();
+    rememberMasterchainBlock(*mc_info->last_);
+    seqno = static_cast<ton::BlockSeqno>(mc_info->last_->seqno_);
+  }
+
+  // every call picks its own worker, the semaphore bounds how many of them are in flight
+  userver::engine::Semaphore semaphore(kMaxParallelCalls);
+  std::vector<userver::engine::TaskWithResult<td::Result<RunGetMethodResult>>> tasks;
+  tasks.reserve(entries.size());
+  for (const auto& entry : entries) {
+    tasks.push_back(userver::utils::Async("rungetmethodbatch_call", [this, &entry, &semaphore, seqno, archival] {
+      std::shared_lock lock(semaphore);
+      auto [result, _] = runGetMethod(entry.address, entry.method, entry.stack, seqno, archival, nullptr);
+      return std::move(result);
+    }));
   }
 
-  return {RunGetMethodResult{result.move_as_ok(), state_result.move_as_ok()}, session};
+  for (auto& task : tasks) {
+    on_result(task.Get());
+  }
+  return {seqno.value(), session};
 }
 
 TonlibWorker::Result<std::unique_ptr<tonlib_api::query_fees>> TonlibWorker::queryEstimateFees(
@@ -1486,22 +2346,16 @@ TonlibWorker::Result<std::unique_ptr<tonlib_api::query_fees>> TonlibWorker::quer
 
 TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJettonMaster(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification,
     std::optional<ton::BlockSeqno> seqno,
     std::optional<bool> archival,
     multiclient::SessionPtr session
 ) const {
-  auto [r_smc_info, new_session] = loadContract(address, seqno, archival, session);
-  session = std::move(new_session);
-  if (!r_smc_info.is_ok()) {
-    return {r_smc_info.move_as_error(), session};
-  }
-  auto smc_info = r_smc_info.move_as_ok();
-
   std::string method_name = "get_jetton_data";
   auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = smc_info->id_, method_ = method_name] {
+    .request_creator = [id_ = smc_id, method_ = method_name] {
       return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(id_,
         tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_),
         std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>{});
@@ -1511,7 +2365,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   auto [res, new_session_2] = send_request_function(std::move(request), false);
   session = std::move(new_session_2);
   if (!res.is_ok()) {
-    return {nullptr, std::move(session)};
+    return {token_check_unavailable(res.move_as_error()), std::move(session)};
   }
   auto result = res.move_as_ok();
   if (result->exit_code_ != 0) {
@@ -1545,13 +2399,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
     return {td::Status::Error(500, "stackEntryCell expected at 3 position"), std::move(session)};
   }
   auto r_jetton_content_cell_data = static_cast<tonlib_api::tvm_stackEntryCell&>(*result->stack_[3]).cell_->bytes_;
-  auto r_jetton_content_cell = vm::std_boc_deserialize(r_jetton_content_cell_data, true, true);
-  if (r_jetton_content_cell.is_error()) {
-    return {r_jetton_content_cell.move_as_error_prefix("Failed to parse jetton content cell: "), std::move(session)};
-  }
-  auto jetton_content_cell = r_jetton_content_cell.move_as_ok();
-
-  auto r_jetton_content = utils::parse_token_data(std::move(jetton_content_cell));
+  auto r_jetton_content = parseTokenContent(r_jetton_content_cell_data);
   if (r_jetton_content.is_error()) {
     return {r_jetton_content.move_as_error_prefix("Failed to parse jetton content from the cell: "), std::move(session)};
   }
@@ -1565,32 +2413,20 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   }
   data->jetton_wallet_code_ = td::base64_encode(static_cast<const tonlib_api::tvm_stackEntryCell&>(*result->stack_[4]).cell_->bytes_);
 
-  auto [forget_result, forget_session] = forgetContract(smc_info->id_, archival, session);
-  session = std::move(forget_session);
-  if (forget_result.is_error()) {
-    return {forget_result.move_as_error(), session};
-  }
-
   return {std::move(data), std::move(session)};
 }
 TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJettonWallet(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification,
     std::optional<ton::BlockSeqno> seqno,
     std::optional<bool> archival,
     multiclient::SessionPtr session
 ) const {
-  auto [r_smc_info, new_session] = loadContract(address, seqno, archival, session);
-  session = std::move(new_session);
-  if (!r_smc_info.is_ok()) {
-    return {r_smc_info.move_as_error(), session};
-  }
-  auto smc_info = r_smc_info.move_as_ok();
-
   std::string method_name = "get_wallet_data";
   auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = smc_info->id_, method_ = method_name] {
+    .request_creator = [id_ = smc_id, method_ = method_name] {
       return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(id_,
         tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_),
         std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>{});
@@ -1600,7 +2436,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   auto [res, new_session_2] = send_request_function(std::move(request), false);
   session = std::move(new_session_2);
   if (!res.is_ok()) {
-    return {nullptr, std::move(session)};
+    return {token_check_unavailable(res.move_as_error()), std::move(session)};
   }
   auto result = res.move_as_ok();
   if (result->exit_code_ != 0) {
@@ -1635,23 +2471,19 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   }
   data->jetton_wallet_code_ = td::base64_encode(static_cast<const tonlib_api::tvm_stackEntryCell&>(*result->stack_[3]).cell_->bytes_);
 
-  auto [forget_result, forget_session] = forgetContract(smc_info->id_, archival, session);
-  session = std::move(forget_session);
-  if (forget_result.is_error()) {
-    return {forget_result.move_as_error(), session};
-  }
-
   if (skip_verification) {
     return {std::move(data), std::move(session)};
   }
 
   // verification
-  auto [r_parent_smc_info, new_session_3] = loadContract(data->jetton_master_address_, seqno, archival, session);
+  auto [r_parent_handle, new_session_3] = acquireContract(data->jetton_master_address_, seqno, archival, session);
   session = std::move(new_session_3);
-  if (!r_parent_smc_info.is_ok()) {
-    return {r_parent_smc_info.move_as_error(), session};
+  if (!r_parent_handle.is_ok()) {
+    return {token_check_unavailable(r_parent_handle.move_as_error()), session};
   }
-  auto parent_smc_info = r_parent_smc_info.move_as_ok();
+  auto parent_handle = r_parent_handle.move_as_ok();
+  // released on every exit, the checks below return early on mismatches
+  userver::utils::ScopeGuard release_parent([this, &parent_handle] { releaseContract(std::move(parent_handle)); });
 
   // construct owner_address cell
   auto r_owner_std_address = block::StdAddress::parse(data->owner_address_);
@@ -1676,7 +2508,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   // call get_wallet_address on master
   auto request_2 = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode=multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = parent_smc_info->id_, owner_address_cell_ = owner_address_cell] {
+    .request_creator = [id_ = parent_handle->id, owner_address_cell_ = owner_address_cell] {
       std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> stack;
       auto tonlib_slice = tonlib_api::make_object<tonlib_api::tvm_slice>(owner_address_cell_);
       auto entry = tonlib_api::make_object<tonlib_api::tvm_stackEntrySlice>(std::move(tonlib_slice));
@@ -1691,8 +2523,8 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   auto [res_2, new_session_4] = send_request_function(std::move(request_2));
   session = std::move(new_session_4);
   if (!res_2.is_ok()) {
-    auto error = res_2.move_as_error();
-    return {std::move(error), std::move(session)};
+    invalidateLostContract(data->jetton_master_address_, seqno, parent_handle, res_2.error());
+    return {token_check_unavailable(res_2.move_as_error()), std::move(session)};
   }
   auto result_2 = res_2.move_as_ok();
   if (result_2->exit_code_ != 0) {
@@ -1749,32 +2581,20 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkJetton
   }
   data->is_validated_ = true;
 
-  auto [parent_forget_result, parent_forget_session] = forgetContract(parent_smc_info->id_, archival, session);
-  session = std::move(parent_forget_session);
-  if (parent_forget_result.is_error()) {
-    return {parent_forget_result.move_as_error(), session};
-  }
-
   return {std::move(data), std::move(session)};
 }
 TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTCollection(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification,
     std::optional<ton::BlockSeqno> seqno,
     std::optional<bool> archival,
     multiclient::SessionPtr session
 ) const {
-  auto [r_smc_info, new_session] = loadContract(address, seqno, archival, session);
-  session = std::move(new_session);
-  if (!r_smc_info.is_ok()) {
-    return {r_smc_info.move_as_error(), session};
-  }
-  auto smc_info = r_smc_info.move_as_ok();
-
   std::string method_name = "get_collection_data";
   auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = smc_info->id_, method_ = method_name] {
+    .request_creator = [id_ = smc_id, method_ = method_name] {
       return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(id_,
         tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_),
         std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>{});
@@ -1784,7 +2604,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTCol
   auto [res, new_session_2] = send_request_function(std::move(request), false);
   session = std::move(new_session_2);
   if (!res.is_ok()) {
-    return {nullptr, std::move(session)};
+    return {token_check_unavailable(res.move_as_error()), std::move(session)};
   }
   auto result = res.move_as_ok();
   if (result->exit_code_ != 0) {
@@ -1807,13 +2627,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTCol
     return {td::Status::Error(500, "stackEntryCell expected at 1 position"), std::move(session)};
   }
   auto r_collection_content_cell_data = static_cast<tonlib_api::tvm_stackEntryCell&>(*result->stack_[1]).cell_->bytes_;
-  auto r_collection_content_cell = vm::std_boc_deserialize(r_collection_content_cell_data, true, true);
-  if (r_collection_content_cell.is_error()) {
-    return {r_collection_content_cell.move_as_error_prefix("Failed to parse jetton content cell: "), std::move(session)};
-  }
-  auto collection_content_cell = r_collection_content_cell.move_as_ok();
-
-  auto r_collection_content = utils::parse_token_data(std::move(collection_content_cell));
+  auto r_collection_content = parseTokenContent(r_collection_content_cell_data);
   if (r_collection_content.is_error()) {
     return {r_collection_content.move_as_error_prefix("Failed to parse jetton content from the cell: "), std::move(session)};
   }
@@ -1828,32 +2642,20 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTCol
   }
   data->owner_address_ = r_owner_address_.move_as_ok();
 
-  auto [forget_result, forget_session] = forgetContract(smc_info->id_, archival, session);
-  session = std::move(forget_session);
-  if (forget_result.is_error()) {
-    return {forget_result.move_as_error(), session};
-  }
-
   return {std::move(data), std::move(session)};
 }
 TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTItem(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification,
     std::optional<ton::BlockSeqno> seqno,
     std::optional<bool> archival,
     multiclient::SessionPtr session
 ) const {
-  auto [r_smc_info, new_session] = loadContract(address, seqno, archival, session);
-  session = std::move(new_session);
-  if (!r_smc_info.is_ok()) {
-    return {r_smc_info.move_as_error(), session};
-  }
-  auto smc_info = r_smc_info.move_as_ok();
-
   std::string method_name = "get_nft_data";
   auto request = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode = multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = smc_info->id_, method_ = method_name] {
+    .request_creator = [id_ = smc_id, method_ = method_name] {
       return tonlib_api::make_object<tonlib_api::smc_runGetMethod>(id_,
         tonlib_api::make_object<tonlib_api::smc_methodIdName>(method_),
         std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>{});
@@ -1863,7 +2665,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   auto [res, new_session_2] = send_request_function(std::move(request), false);
   session = std::move(new_session_2);
   if (!res.is_ok()) {
-    return {nullptr, std::move(session)};
+    return {token_check_unavailable(res.move_as_error()), std::move(session)};
   }
   auto result = res.move_as_ok();
   if (result->exit_code_ != 0) {
@@ -1907,13 +2709,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   auto ind_content_cell_data = static_cast<tonlib_api::tvm_stackEntryCell&>(*result->stack_[4]).cell_->bytes_;
 
   if (data->collection_address_.empty()) {
-    auto r_content_cell = vm::std_boc_deserialize(ind_content_cell_data, true, true);
-    if (r_content_cell.is_error()) {
-      return {r_content_cell.move_as_error_prefix("Failed to parse jetton content cell: "), std::move(session)};
-    }
-    auto content_cell = r_content_cell.move_as_ok();
-
-    auto r_content = utils::parse_token_data(std::move(content_cell));
+    auto r_content = parseTokenContent(ind_content_cell_data);
     if (r_content.is_error()) {
       return {r_content.move_as_error_prefix("Failed to parse jetton content from the cell: "), std::move(session)};
     }
@@ -1922,12 +2718,6 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
     data->content_ = std::move(content);
   }
 
-  auto [forget_result, forget_session] = forgetContract(smc_info->id_, archival, session);
-  session = std::move(forget_session);
-  if (forget_result.is_error()) {
-    return {forget_result.move_as_error(), session};
-  }
-
   if (skip_verification) {
     return {std::move(data), std::move(session)};
   }
@@ -1937,17 +2727,19 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
     data->is_validated_ = true;
     return {std::move(data), std::move(session)};
   }
-  auto [r_parent_smc_info, new_session_3] = loadContract(data->collection_address_, seqno, archival, session);
+  auto [r_parent_handle, new_session_3] = acquireContract(data->collection_address_, seqno, archival, session);
   session = std::move(new_session_3);
-  if (!r_parent_smc_info.is_ok()) {
-    return {r_parent_smc_info.move_as_error(), session};
+  if (!r_parent_handle.is_ok()) {
+    return {token_check_unavailable(r_parent_handle.move_as_error()), session};
   }
-  auto parent_smc_info = r_parent_smc_info.move_as_ok();
+  auto parent_handle = r_parent_handle.move_as_ok();
+  // released on every exit, the checks below return early on mismatches
+  userver::utils::ScopeGuard release_parent([this, &parent_handle] { releaseContract(std::move(parent_handle)); });
 
   // verify with master
   auto request_2 = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode=multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = parent_smc_info->id_, index_ = data->index_] {
+    .request_creator = [id_ = parent_handle->id, index_ = data->index_] {
       std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> stack;
       auto tonlib_slice = tonlib_api::make_object<tonlib_api::tvm_numberDecimal>(index_);
       auto entry = tonlib_api::make_object<tonlib_api::tvm_stackEntryNumber>(std::move(tonlib_slice));
@@ -1962,8 +2754,8 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   auto [res_2, new_session_4] = send_request_function(std::move(request_2));
   session = std::move(new_session_4);
   if (!res_2.is_ok()) {
-    auto error = res_2.move_as_error();
-    return {std::move(error), std::move(session)};
+    invalidateLostContract(data->collection_address_, seqno, parent_handle, res_2.error());
+    return {token_check_unavailable(res_2.move_as_error()), std::move(session)};
   }
   auto result_2 = res_2.move_as_ok();
   if (result_2->exit_code_ != 0) {
@@ -2000,7 +2792,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   // content_
   auto request_3 = multiclient::RequestFunction<tonlib_api::smc_runGetMethod>{
     .parameters = {.mode=multiclient::RequestMode::Single, .archival = archival},
-    .request_creator = [id_ = parent_smc_info->id_, index_ = data->index_, ind_content = std::move(ind_content_cell_data)] {
+    .request_creator = [id_ = parent_handle->id, index_ = data->index_, ind_content = std::move(ind_content_cell_data)] {
       std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> stack;
       auto tonlib_slice = tonlib_api::make_object<tonlib_api::tvm_numberDecimal>(index_);
       auto entry = tonlib_api::make_object<tonlib_api::tvm_stackEntryNumber>(std::move(tonlib_slice));
@@ -2019,8 +2811,8 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   auto [res_3, new_session_5] = send_request_function(std::move(request_3));
   session = std::move(new_session_5);
   if (!res_3.is_ok()) {
-    auto error = res_3.move_as_error();
-    return {std::move(error), std::move(session)};
+    invalidateLostContract(data->collection_address_, seqno, parent_handle, res_3.error());
+    return {token_check_unavailable(res_3.move_as_error()), std::move(session)};
   }
   auto result_3 = res_3.move_as_ok();
   if (result_3->exit_code_ != 0) {
@@ -2029,13 +2821,7 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   }
   auto& content_data_str = static_cast<tonlib_api::tvm_stackEntryCell&>(*(result_3->stack_[0])).cell_->bytes_;
 
-  auto r_content_cell = vm::std_boc_deserialize(content_data_str, true, true);
-  if (r_content_cell.is_error()) {
-    return {r_content_cell.move_as_error_prefix("Failed to parse jetton content cell: "), std::move(session)};
-  }
-  auto content_cell = r_content_cell.move_as_ok();
-
-  auto r_content = utils::parse_token_data(std::move(content_cell));
+  auto r_content = parseTokenContent(content_data_str);
   if (r_content.is_error()) {
     return {r_content.move_as_error_prefix("Failed to parse jetton content from the cell: "), std::move(session)};
   }
@@ -2046,13 +2832,6 @@ TonlibWorker::Result<std::unique_ptr<TokenDataResult>> TonlibWorker::checkNFTIte
   // dns_entry_
   // TODO: implement dns entry parsing
 
-  auto [parent_forget_result, parent_forget_session] = forgetContract(parent_smc_info->id_, archival, session);
-  session = std::move(parent_forget_session);
-  if (parent_forget_result.is_error()) {
-    return {parent_forget_result.move_as_error(), session};
-  }
-
-
   return {std::move(data), std::move(session)};
 }
 }  // namespace ton_http::core
@@ -1,11 +1,19 @@
 #pragma once
+#include <chrono>
+#include <functional>
+
+#include "contract_cache.h"
+#include "message_index.h"
 #include "tonlib-multiclient/multi_client.h"
 #include "tl/tl_json.h"
 #include "auto/tl/tonlib_api.h"
 #include "auto/tl/tonlib_api_json.h"
 #include "td/utils/JsonBuilder.h"
 #include "tonlib-multiclient/request.h"
+#include "transaction_chain_index.h"
+#include "userver/cache/lru_map.hpp"
 #include "userver/engine/future.hpp"
+#include "userver/engine/mutex.hpp"
 
 namespace ton_http::core {
 // new schemas
@@ -35,11 +43,18 @@ struct RunGetMethodResult {
   [[nodiscard]] std::string to_json_string() const;
 };
 
+struct RunGetMethodBatchEntry {
+  std::string address;
+  std::string method;
+  std::vector<std::string> stack;
+};
+
 struct TokenDataResult {
   explicit TokenDataResult(const std::string& address) : address_(address) {}
   virtual ~TokenDataResult() = default;
   std::string address_;
   [[nodiscard]] virtual std::string to_json_string() const;
+  [[nodiscard]] virtual std::unique_ptr<TokenDataResult> clone() const;
 };
 using TokenDataResultPtr = std::unique_ptr<TokenDataResult>;
 
@@ -52,6 +67,7 @@ struct JettonMasterDataResult: public TokenDataResult {
   std::string jetton_wallet_code_;
   explicit JettonMasterDataResult(const std::string& address) : TokenDataResult(address) {}
   [[nodiscard]] std::string to_json_string() const override;
+  [[nodiscard]] std::unique_ptr<TokenDataResult> clone() const override;
 };
 
 struct JettonWalletDataResult: public TokenDataResult {
@@ -64,6 +80,7 @@ struct JettonWalletDataResult: public TokenDataResult {
 
   explicit JettonWalletDataResult(const std::string& address) : TokenDataResult(address) {}
   [[nodiscard]] std::string to_json_string() const override;
+  [[nodiscard]] std::unique_ptr<TokenDataResult> clone() const override;
 };
 
 struct NFTCollectionDataResult : public TokenDataResult {
@@ -74,6 +91,7 @@ struct NFTCollectionDataResult : public TokenDataResult {
 
   explicit NFTCollectionDataResult(const std::string& address) : TokenDataResult(address) {}
   [[nodiscard]] std::string to_json_string() const override;
+  [[nodiscard]] std::unique_ptr<TokenDataResult> clone() const override;
 };
 
 struct NFTItemDataResult : public TokenDataResult {
@@ -87,16 +105,25 @@ struct NFTItemDataResult : public TokenDataResult {
   // TODO: implement dns entry parsing
   explicit NFTItemDataResult(const std::string& address) : TokenDataResult(address) {}
   [[nodiscard]] std::string to_json_string() const override;
+  [[nodiscard]] std::unique_ptr<TokenDataResult> clone() const override;
 };
 
 // TonlibWorker
+enum class CacheMode : std::uint8_t {
+  Head,       // depends on the masterchain head, dropped once a newer consensus block is observed
+  Timed,      // head state that changes rarely, lives for its TTL regardless of new blocks
+  Immutable,  // can never change once it is available (explicit seqno, block or transaction id)
+};
+
 struct TonlibWorkerResponse {
   bool is_ok{false};
   tonlib_api::object_ptr<tonlib_api::Object> result{nullptr};
   std::optional<std::string> result_str{std::nullopt};
   std::optional<td::Status> error{std::nullopt};
   multiclient::SessionPtr session{nullptr};
-  int cache_ttl{0};
+  std::chrono::milliseconds cache_ttl{0};
+  std::chrono::milliseconds cache_stale_ttl{0};
+  CacheMode cache_mode{CacheMode::Head};
 
   template<typename T>
   static TonlibWorkerResponse from_tonlib_result(td::Result<T>&& result, multiclient::SessionPtr&& session = nullptr) {
@@ -115,21 +142,57 @@ struct TonlibWorkerResponse {
   static TonlibWorkerResponse from_error_string(const std::string& error, const int code = 0, multiclient::SessionPtr&& session = nullptr) {
     return {false, nullptr, std::nullopt, td::Status::Error(code, error), std::move(session)};
   }
-  TonlibWorkerResponse Cachable(int ttl = 1) {
+  TonlibWorkerResponse Cachable(std::chrono::milliseconds ttl = std::chrono::seconds(1)) {
     cache_ttl = ttl;
     return std::move(*this);
   }
+  // allows serving expired response for stale_ttl while it is refreshed in background
+  TonlibWorkerResponse StaleWhileRevalidate(std::chrono::milliseconds stale_ttl) {
+    cache_stale_ttl = stale_ttl;
+    return std::move(*this);
+  }
+  TonlibWorkerResponse Timed(bool is_timed = true) {
+    if (is_timed) {
+      cache_mode = CacheMode::Timed;
+    }
+    return std::move(*this);
+  }
+  TonlibWorkerResponse Immutable(bool is_immutable = true) {
+    if (is_immutable) {
+      cache_mode = CacheMode::Immutable;
+    }
+    return std::move(*this);
+  }
 };
 
 class TonlibWorker {
 public:
-  explicit TonlibWorker(const multiclient::MultiClientConfig& config) : tonlib_(config) {};
+  static constexpr std::size_t kDefaultTransactionIndexSize = 131072;
+
+  explicit TonlibWorker(
+      const multiclient::MultiClientConfig& config,
+      std::size_t contract_cache_size = 0,
+      std::shared_ptr<TransactionChainIndex> tx_index = nullptr,
+      std::shared_ptr<MessageIndex> msg_index = nullptr
+  ) :
+      tonlib_(config), contract_cache_(contract_cache_size), library_cache_(kLibraryCacheSize),
+      mc_block_cache_(kMasterchainBlockCacheSize),
+      tx_index_(tx_index ? std::move(tx_index) : std::make_shared<TransactionChainIndex>(kDefaultTransactionIndexSize)),
+      token_content_cache_(kTokenContentCacheSize), token_data_cache_(kTokenDataCacheSize),
+      prepared_get_method_cache_(kPreparedGetMethodCacheSize),
+      msg_index_(std::move(msg_index)) {};
   ~TonlibWorker() = default;
 
   template<typename T>
   using Result = std::pair<td::Result<T>, multiclient::SessionPtr>;
+  // transactions of a list response handed over page by page, in the order of the response
+  using TransactionPage = std::vector<tonlib_api::object_ptr<tonlib_api::raw_transaction>>;
+  using TransactionPageCallback = std::function<void(TransactionPage&&)>;
 
   Result<ConsensusBlockResult> getConsensusBlock(multiclient::SessionPtr session = nullptr) const;
+  std::int32_t getLastConsensusBlock() const {
+    return tonlib_.get_last_consensus_block();
+  }
   Result<DetectAddressResult> detectAddress(const std::string& address, multiclient::SessionPtr session = nullptr) const;
   Result<std::string> packAddress(const std::string& address, multiclient::SessionPtr session = nullptr) const;
   Result<std::string> unpackAddress(const std::string& address, multiclient::SessionPtr session = nullptr) const;
@@ -231,6 +294,20 @@ public:
     std::optional<bool> archival = std::nullopt,
     multiclient::SessionPtr session = nullptr
   ) const;
+  // getBlockTransactionsExt passing transactions to `on_page` as they arrive, the result holds no transactions
+  Result<tonlib_api::blocks_getTransactionsExt::ReturnType> streamBlockTransactionsExt(
+    const ton::WorkchainId& workchain,
+    const ton::ShardId& shard,
+    const ton::BlockSeqno& seqno,
+    const size_t count,
+    const std::string& root_hash,
+    const std::string& file_hash,
+    const std::optional<ton::LogicalTime>& after_lt,
+    const std::string& after_hash,
+    std::optional<bool> archival,
+    const TransactionPageCallback& on_page,
+    multiclient::SessionPtr session = nullptr
+  ) const;
 
   Result<tonlib_api::raw_getTransactionsV2::ReturnType> getTransactions(
     const std::string& account_address,
@@ -243,6 +320,19 @@ public:
     std::optional<bool> archival = std::nullopt,
     multiclient::SessionPtr session = nullptr
   ) const;
+  // getTransactions passing transactions to `on_page` as chunks arrive, the result holds previous_transaction_id_ only
+  Result<tonlib_api::raw_getTransactionsV2::ReturnType> streamTransactions(
+    const std::string& account_address,
+    std::optional<ton::LogicalTime> from_transaction_lt,
+    std::string from_transaction_hash,
+    ton::LogicalTime to_transaction_lt,
+    size_t count,
+    size_t chunk_size,
+    bool try_decode_messages,
+    std::optional<bool> archival,
+    const TransactionPageCallback& on_page,
+    multiclient::SessionPtr session = nullptr
+  ) const;
 
   Result<tonlib_api::raw_getTransactionsV2::ReturnType> tryLocateTransactionByIncomingMessage(
     const std::string& source,
@@ -255,6 +345,9 @@ public:
       ton::LogicalTime created_lt,
       multiclient::SessionPtr session = nullptr) const;
 
+  // feeds the message index with blocks that appeared since the previous call, must not run concurrently
+  td::Status indexNewBlocks() const;
+
   Result<tonlib_api::raw_sendMessage::ReturnType> raw_sendMessage(
     const std::string& boc,
     multiclient::SessionPtr session = nullptr) const;
@@ -284,6 +377,24 @@ public:
     multiclient::SessionPtr session = nullptr
   ) const;
 
+  // runs every entry at the same masterchain block, results are in the order of entries
+  Result<std::vector<td::Result<RunGetMethodResult>>> runGetMethodBatch(
+    const std::vector<RunGetMethodBatchEntry>& entries,
+    std::optional<ton::BlockSeqno> seqno = std::nullopt,
+    std::optional<bool> archival = std::nullopt,
+    multiclient::SessionPtr session = nullptr
+  ) const;
+  using RunGetMethodResultCallback = std::function<void(td::Result<RunGetMethodResult>&&)>;
+  // same as runGetMethodBatch, every result is passed to `on_result` as soon as the ones before it are done;
+  // returns the seqno of the masterchain block the batch ran at
+  Result<ton::BlockSeqno> streamRunGetMethodBatch(
+    const std::vector<RunGetMethodBatchEntry>& entries,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    const RunGetMethodResultCallback& on_result,
+    multiclient::SessionPtr session = nullptr
+  ) const;
+
   Result<tonlib_api::query_estimateFees::ReturnType> queryEstimateFees(
     const std::string& account_address,
     const std::string& body,
@@ -295,9 +406,112 @@ public:
 
 private:
   multiclient::MultiClient tonlib_;
+  mutable ContractCache contract_cache_;
+  // library cells are addressed by their hash, so they never change once fetched
+  static constexpr std::size_t kLibraryCacheSize = 4096;
+  mutable userver::engine::Mutex library_cache_mutex_;
+  mutable userver::cache::LruMap<std::string, std::string> library_cache_;
+  // masterchain block ids resolved by seqno, final once the block exists
+  static constexpr std::size_t kMasterchainBlockCacheSize = 1024;
+  mutable userver::engine::Mutex mc_block_cache_mutex_;
+  mutable userver::cache::LruMap<ton::BlockSeqno, ton::BlockIdExt> mc_block_cache_;
+  void rememberMasterchainBlock(const tonlib_api::ton_blockIdExt& blk_id) const;
+  std::shared_ptr<TransactionChainIndex> tx_index_;
+
+  // token metadata parsed from content cells by sha256 of their boc, popular tokens return the same cells
+  using TokenContent = std::tuple<bool, std::map<std::string, std::string>>;
+  static constexpr std::size_t kTokenContentCacheSize = 4096;
+  mutable userver::engine::Mutex token_content_cache_mutex_;
+  mutable userver::cache::LruMap<std::string, TokenContent> token_content_cache_;
+  td::Result<TokenContent> parseTokenContent(const std::string& boc) const;
+
+  // latest token data by account, code hash and verification mode, valid until the account's last transaction changes;
+  // the kind of the token survives such changes and narrows down the next detection, negatives don't
+  struct TokenDataCacheEntry {
+    TransactionId last_transaction_id;
+    std::optional<std::size_t> kind;
+    std::shared_ptr<const TokenDataResult> data;
+  };
+  static constexpr std::size_t kTokenDataCacheSize = 4096;
+  mutable userver::engine::Mutex token_data_cache_mutex_;
+  mutable userver::cache::LruMap<std::string, std::shared_ptr<const TokenDataCacheEntry>> token_data_cache_;
+
+  // runGetMethod arguments parsed into tonlib objects once, requests to workers get clones of them
+  struct PreparedGetMethod {
+    std::string method_name;
+    std::optional<std::int64_t> method_number;
+    std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> stack;
+
+    [[nodiscard]] tonlib_api::object_ptr<tonlib_api::smc_runGetMethod> make_request(std::int64_t smc_id) const;
+  };
+  using PreparedGetMethodPtr = std::shared_ptr<const PreparedGetMethod>;
+  // identical calls share the prepared arguments
+  static constexpr std::size_t kPreparedGetMethodCacheSize = 1024;
+  mutable userver::engine::Mutex prepared_get_method_cache_mutex_;
+  mutable userver::cache::LruMap<std::string, PreparedGetMethodPtr> prepared_get_method_cache_;
+  td::Result<PreparedGetMethodPtr> prepareGetMethod(
+    const std::string& method_name,
+    const std::vector<std::string>& stack
+  ) const;
+
+  // recent messages indexed in the background, nullptr if disabled
+  std::shared_ptr<MessageIndex> msg_index_;
+  mutable std::optional<ton::BlockSeqno> indexed_mc_seqno_;
+  mutable std::map<std::pair<ton::WorkchainId, ton::ShardId>, ton::BlockSeqno> indexed_shard_seqnos_;
+  td::Status indexMasterchainBlock(ton::BlockSeqno mc_seqno) const;
+  Result<tonlib_api::raw_getTransactionsV2::ReturnType> getLocatedTransaction(
+    const MessageIndex::Location& location,
+    multiclient::SessionPtr session
+  ) const;
+
+  // fetches transactions of a block from the start, splitting the shard account space into ranges
+  // scanned concurrently; T is blocks_transactions or blocks_transactionsExt. Transactions are passed
+  // to `on_page` range by range, the result holds everything else
+  template <typename T, typename Fetch, typename TxCursor, typename OnPage>
+  Result<tonlib_api::object_ptr<T>> scanBlockTransactions(
+    const tonlib_api::object_ptr<tonlib_api::ton_blockIdExt>& blk_id,
+    size_t count,
+    std::optional<bool> archival,
+    multiclient::SessionPtr session,
+    Fetch fetch,
+    TxCursor tx_cursor,
+    OnPage on_page
+  ) const;
+
+  // searches the transaction of the account accepted by `match` near created_lt, probing every shard
+  // of the account at `lt_probes` lt offsets concurrently
+  template <typename Match>
+  Result<tonlib_api::raw_getTransactionsV2::ReturnType> locateTransaction(
+    const block::StdAddress& account,
+    const std::string& account_address,
+    ton::LogicalTime created_lt,
+    size_t lt_probes,
+    multiclient::SessionPtr session,
+    Match match
+  ) const;
+
+  // loadContract through the contract cache, pass the handle to releaseContract after use
+  // to forget contracts that dropped out of the cache
+  Result<ContractHandlePtr> acquireContract(
+    const std::string& address,
+    std::optional<ton::BlockSeqno> seqno = std::nullopt,
+    std::optional<bool> archival = std::nullopt,
+    multiclient::SessionPtr session = nullptr,
+    bool force_reload = false
+  ) const;
+  void releaseContract(ContractHandlePtr&& handle) const;
+  // drops a cached handle that failed because tonlib doesn't hold the contract anymore
+  void invalidateLostContract(
+    const std::string& address,
+    std::optional<ton::BlockSeqno> seqno,
+    const ContractHandlePtr& handle,
+    const td::Status& error
+  ) const;
+  std::optional<ContractCache::Key> contractCacheKey(const std::string& address, std::optional<ton::BlockSeqno> seqno) const;
 
   Result<TokenDataResultPtr> checkJettonMaster(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification = false,
     std::optional<ton::BlockSeqno> seqno = std::nullopt,
     std::optional<bool> archival = std::nullopt,
@@ -305,6 +519,7 @@ private:
   ) const;
   Result<TokenDataResultPtr> checkJettonWallet(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification = false,
     std::optional<ton::BlockSeqno> seqno = std::nullopt,
     std::optional<bool> archival = std::nullopt,
@@ -312,6 +527,7 @@ private:
   ) const;
   Result<TokenDataResultPtr> checkNFTCollection(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification = false,
     std::optional<ton::BlockSeqno> seqno = std::nullopt,
     std::optional<bool> archival = std::nullopt,
@@ -319,11 +535,21 @@ private:
   ) const;
   Result<TokenDataResultPtr> checkNFTItem(
     const std::string& address,
+    std::int64_t smc_id,
     bool skip_verification = false,
     std::optional<ton::BlockSeqno> seqno = std::nullopt,
     std::optional<bool> archival = std::nullopt,
     multiclient::SessionPtr session = nullptr
   ) const;
+  // runs the token checks, or only the one of a known kind, and returns the kind that matched with its data
+  Result<std::pair<std::size_t, TokenDataResultPtr>> detectTokenData(
+    const std::string& address,
+    bool skip_verification,
+    std::optional<ton::BlockSeqno> seqno,
+    std::optional<bool> archival,
+    std::optional<std::size_t> kind,
+    multiclient::SessionPtr session
+  ) const;
 
   template<typename T>
   Result<typename T::ReturnType> send_request_function(multiclient::RequestFunction<T>&& request, bool retry_archival = false) const {
@@ -0,0 +1,180 @@
+#include "transaction_chain_index.h"
+
+#include <mutex>
+
+#include "td/utils/misc.h"
+#include "userver/logging/log.hpp"
+#include "userver/utils/async.hpp"
+
+namespace ton_http::core {
+
+namespace {
+constexpr std::size_t kHashSize = 32;
+}
+
+TransactionChainIndex::TransactionChainIndex(
+    std::size_t capacity, const std::optional<std::string>& db_path, userver::engine::TaskProcessor* fs_task_processor
+) :
+    capacity_(capacity), fs_task_processor_(fs_task_processor) {
+  if (!db_path.has_value()) {
+    return;
+  }
+  if (fs_task_processor_ == nullptr) {
+    throw std::runtime_error("fs task processor is required to persist transaction index");
+  }
+  auto r_db = td::RocksDb::open(db_path.value());
+  if (r_db.is_error()) {
+    throw std::runtime_error("failed to open transaction index at " + db_path.value() + ": " + r_db.error().to_string());
+  }
+  db_ = std::make_unique<td::RocksDb>(r_db.move_as_ok());
+  write_tasks_.emplace(*fs_task_processor_);
+}
+
+std::string TransactionChainIndex::MakeDbKey(const std::string& account, ton::LogicalTime lt) {
+  return account + ":" + std::to_string(lt);
+}
+
+void TransactionChainIndex::Remember(const std::string& account, const tonlib_api::raw_transactions& txs) {
+  if (txs.transactions_.empty() || !txs.previous_transaction_id_) {
+    return;
+  }
+  std::vector<std::pair<ton::LogicalTime, Link>> links;
+  links.reserve(txs.transactions_.size());
+  for (std::size_t i = 0; i < txs.transactions_.size(); ++i) {
+    const auto& tx_id = txs.transactions_[i]->transaction_id_;
+    const auto& prev_id =
+        (i + 1 < txs.transactions_.size()) ? txs.transactions_[i + 1]->transaction_id_ : txs.previous_transaction_id_;
+    links.emplace_back(tx_id->lt_, Link{tx_id->hash_, prev_id->lt_, prev_id->hash_});
+  }
+
+  {
+    std::lock_guard lock(mutex_);
+    for (const auto& [lt, link] : links) {
+      Insert(account, lt, link);
+    }
+    Evict();
+  }
+
+  if (!db_) {
+    return;
+  }
+  // write batches of td::RocksDb are not shared between threads, so links are stored one by one
+  write_tasks_->AsyncDetach("tx_index_put", [this, account, links = std::move(links)] {
+    for (const auto& [lt, link] : links) {
+      if (link.hash.size() != kHashSize || link.prev_hash.size() != kHashSize) {
+        continue;
+      }
+      auto status = db_->set(MakeDbKey(account, lt), link.hash + link.prev_hash + std::to_string(link.prev_lt));
+      if (status.is_error()) {
+        LOG_WARNING() << "transaction index store failed: " << status.to_string();
+        return;
+      }
+    }
+  });
+}
+
+std::optional<TransactionId> TransactionChainIndex::Skip(
+    const std::string& account, TransactionId from, std::size_t count
+) {
+  auto [reached, left] = SkipInMemory(account, std::move(from), count);
+  if (left == 0 || reached.lt == 0) {
+    return reached;
+  }
+  if (!db_) {
+    return std::nullopt;
+  }
+  return SkipInDatabase(account, std::move(reached), left);
+}
+
+std::pair<TransactionId, std::size_t> TransactionChainIndex::SkipInMemory(
+    const std::string& account, TransactionId from, std::size_t count
+) {
+  std::lock_guard lock(mutex_);
+  auto account_it = accounts_.find(account);
+  if (account_it == accounts_.end()) {
+    return {std::move(from), count};
+  }
+  auto& [links, lru_it] = account_it->second;
+  lru_.splice(lru_.begin(), lru_, lru_it);
+
+  auto it = links.find(from.lt);
+  for (; count > 0 && from.lt != 0; --count) {
+    if (it == links.end() || it->second.hash != from.hash) {
+      break;
+    }
+    from = TransactionId{it->second.prev_lt, it->second.prev_hash};
+    // the previous transaction has the next lower lt of the account, so it can only be the neighbour
+    it = (it != links.begin() && std::prev(it)->first == from.lt) ? std::prev(it) : links.end();
+  }
+  return {std::move(from), count};
+}
+
+std::optional<TransactionId> TransactionChainIndex::SkipInDatabase(
+    const std::string& account, TransactionId from, std::size_t count
+) {
+  auto task = userver::utils::Async(*fs_task_processor_, "tx_index_get", [this, &account, from, count]() mutable {
+    std::vector<std::pair<ton::LogicalTime, Link>> loaded;
+    std::optional<TransactionId> result;
+    for (; count > 0 && from.lt != 0; --count) {
+      std::string value;
+      auto r_status = db_->get(MakeDbKey(account, from.lt), value);
+      if (r_status.is_error()) {
+        LOG_WARNING() << "transaction index lookup failed: " << r_status.error().to_string();
+        return std::make_pair(std::move(loaded), result);
+      }
+      if (r_status.ok() != td::KeyValue::GetStatus::Ok || value.size() <= 2 * kHashSize) {
+        return std::make_pair(std::move(loaded), result);
+      }
+      Link link{value.substr(0, kHashSize), 0, value.substr(kHashSize, kHashSize)};
+      if (link.hash != from.hash) {
+        return std::make_pair(std::move(loaded), result);
+      }
+      // a corrupt value ends the known span like a missing one
+      auto r_prev_lt = td::to_integer_safe<ton::LogicalTime>(value.substr(2 * kHashSize));
+      if (r_prev_lt.is_error()) {
+        LOG_WARNING() << "transaction index has a malformed link: " << r_prev_lt.error().to_string();
+        return std::make_pair(std::move(loaded), result);
+      }
+      link.prev_lt = r_prev_lt.move_as_ok();
+      auto lt = from.lt;
+      from = TransactionId{link.prev_lt, link.prev_hash};
+      loaded.emplace_back(lt, std::move(link));
+    }
+    result = std::move(from);
+    return std::make_pair(std::move(loaded), result);
+  });
+  auto [loaded, result] = task.Get();
+
+  // keep the loaded span in memory, the next pages of the same history will need it
+  std::lock_guard lock(mutex_);
+  for (auto& [lt, link] : loaded) {
+    Insert(account, lt, std::move(link));
+  }
+  Evict();
+  return result;
+}
+
+void TransactionChainIndex::Insert(const std::string& account, ton::LogicalTime lt, Link link) {
+  auto [account_it, is_new] = accounts_.try_emplace(account);
+  auto& entry = account_it->second;
+  if (is_new) {
+    lru_.push_front(account);
+    entry.lru_it = lru_.begin();
+  } else {
+    lru_.splice(lru_.begin(), lru_, entry.lru_it);
+  }
+  if (entry.links.insert_or_assign(lt, std::move(link)).second) {
+    ++size_;
+  }
+}
+
+void TransactionChainIndex::Evict() {
+  // the most recently used account is never evicted, even if it doesn't fit alone
+  while (size_ > capacity_ && lru_.size() > 1) {
+    auto account_it = accounts_.find(lru_.back());
+    size_ -= account_it->second.links.size();
+    accounts_.erase(account_it);
+    lru_.pop_back();
+  }
+}
+}  // namespace ton_http::core
@@ -0,0 +1,70 @@
+#pragma once
+#include <list>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+
+#include "auto/tl/tonlib_api.h"
+#include "td/db/RocksDb.h"
+#include "ton/ton-types.h"
+#include "userver/concurrent/background_task_storage.hpp"
+#include "userver/engine/mutex.hpp"
+#include "userver/engine/task/task_processor_fwd.hpp"
+
+namespace ton_http::core {
+
+struct TransactionId {
+  ton::LogicalTime lt;
+  std::string hash;
+};
+
+// Index of account transaction chains: (account, lt) -> (hash, previous lt, previous hash).
+// Links of an account are kept ordered by lt, so the predecessor of a known transaction is either the
+// neighbouring entry or unknown, and skipping over a known span of the chain doesn't need the liteserver.
+// Accounts are evicted in LRU order once the number of links exceeds the capacity.
+// With a database path the links are also persisted and looked up there on in-memory misses.
+class TransactionChainIndex {
+public:
+  TransactionChainIndex(
+      std::size_t capacity,
+      const std::optional<std::string>& db_path = std::nullopt,
+      userver::engine::TaskProcessor* fs_task_processor = nullptr
+  );
+
+  // records links between the transactions of a raw_getTransactionsV2 response
+  void Remember(const std::string& account, const tonlib_api::raw_transactions& txs);
+  // id of the transaction `count` steps back from `from`, if the whole span is known
+  std::optional<TransactionId> Skip(const std::string& account, TransactionId from, std::size_t count);
+
+private:
+  struct Link {
+    std::string hash;
+    ton::LogicalTime prev_lt;
+    std::string prev_hash;
+  };
+  struct Account {
+    std::map<ton::LogicalTime, Link> links;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  // walks the chain in memory, returns the reached transaction and the number of steps left
+  std::pair<TransactionId, std::size_t> SkipInMemory(const std::string& account, TransactionId from, std::size_t count);
+  std::optional<TransactionId> SkipInDatabase(const std::string& account, TransactionId from, std::size_t count);
+  void Insert(const std::string& account, ton::LogicalTime lt, Link link);
+  void Evict();
+  static std::string MakeDbKey(const std::string& account, ton::LogicalTime lt);
+
+  const std::size_t capacity_;
+  userver::engine::Mutex mutex_;
+  std::unordered_map<std::string, Account> accounts_;
+  std::list<std::string> lru_;
+  std::size_t size_{0};
+
+  userver::engine::TaskProcessor* fs_task_processor_;
+  std::unique_ptr<td::RocksDb> db_;
+  // must be the last member, pending writes are cancelled before the database is closed
+  std::optional<userver::concurrent::BackgroundTaskStorage> write_tasks_;
+};
+}  // namespace ton_http::core
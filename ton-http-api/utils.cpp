@@ -1,5 +1,8 @@
 #include "utils.hpp"
 
+#include <array>
+#include <charconv>
+
 #include "auto/tl/tonlib_api.hpp"
 #include "auto/tl/tonlib_api_json.h"
 #include "block/block.h"
@@ -20,15 +23,6 @@
 
 using namespace ton;
 
-std::string to_hex_string_with_prefix(td::RefInt256& val) {
-  auto res = val->to_hex_string();
-  if (res[0] == '-') {
-    return "-0x" + res.substr(1, res.size() - 1);
-  }
-  return "0x" + res;
-}
-
-
 td::Result<userver::formats::json::Value>  ton_http::utils::render_tvm_stack(const std::string& stack_str) {
   using namespace userver::formats::json;
 
@@ -110,73 +104,152 @@ td::Result<userver::formats::json::Value> ton_http::utils::render_tvm_element(
   return td::Status::Error(422, ss.str());
 }
 
-
-userver::formats::json::Value ton_http::utils::serialize_tvm_entry(tonlib_api::tvm_stackEntryCell& entry) {
-  using namespace userver::formats::json;
-  ValueBuilder builder;
-
-  builder["bytes"] = td::base64_encode(entry.cell_->bytes_);
-
-  auto r_cell = vm::std_boc_deserialize(entry.cell_->bytes_);
-  if (r_cell.is_error()) {
-    builder["object"] ["error"] = r_cell.move_as_error().to_string();
-    return builder.ExtractValue();
+std::string ton_http::utils::dec_to_hex_with_prefix(td::Slice dec) {
+  // most numbers on the stack fit into 64 bits and don't need bigint arithmetic
+  const bool negative = !dec.empty() && dec[0] == '-';
+  const auto digits = negative ? dec.substr(1) : dec;
+  std::uint64_t value = 0;
+  auto [digits_end, ec] = std::from_chars(digits.begin(), digits.end(), value);
+  if (!digits.empty() && ec == std::errc() && digits_end == digits.end()) {
+    std::array<char, 2 * sizeof(value)> hex{};
+    auto [hex_end, _] = std::to_chars(hex.data(), hex.data() + hex.size(), value, 16);
+    std::string res = negative && value != 0 ? "-0x" : "0x";
+    res.append(hex.data(), hex_end);
+    return res;
   }
-  auto cell = r_cell.move_as_ok();
-  builder["object"] = serialize_cell(cell);
 
-  return builder.ExtractValue();
+  auto number = td::string_to_int256(dec.str());
+  if (number.is_null()) {
+    return dec.str();
+  }
+  auto res = number->to_hex_string();
+  if (res[0] == '-') {
+    return "-0x" + res.substr(1, res.size() - 1);
+  }
+  return "0x" + res;
 }
 
+namespace {
+class JsonCell final : public td::Jsonable {
+public:
+  explicit JsonCell(td::Ref<vm::Cell> cell) : cell_(std::move(cell)) {}
+
+  void store(td::JsonValueScope* scope) const {
+    auto jo = scope->enter_object();
+    bool is_special = false;
+    auto cs = vm::load_cell_slice_special(cell_, is_special);
+    auto r_ls = cell_->load_cell();
+    if (r_ls.is_error()) {
+      jo("error", td::JsonString(r_ls.move_as_error().to_string()));
+      return;
+    }
+    auto ls = r_ls.move_as_ok();
+    const auto bits = ls.data_cell->get_bits();
+    jo("data", JsonCellData(td::Slice(ls.data_cell->get_data(), (bits + 7) / 8), bits));
+    jo("refs", td::json_array([&](auto& arr) {
+      for (unsigned i = 0; i < cs.size_refs(); ++i) {
+        arr(JsonCell(cs.prefetch_ref(i)));
+      }
+    }));
+    jo("special", td::JsonBool(ls.data_cell->is_special()));
+  }
 
-userver::formats::json::Value ton_http::utils::serialize_tvm_entry(tonlib_api::tvm_stackEntrySlice& entry) {
-  using namespace userver::formats::json;
-  ValueBuilder builder;
+private:
+  class JsonCellData final : public td::Jsonable {
+  public:
+    JsonCellData(td::Slice data, unsigned bits) : data_(data), bits_(bits) {}
 
-  builder["bytes"] = td::base64_encode(entry.slice_->bytes_);
-  auto r_cell = vm::std_boc_deserialize(entry.slice_->bytes_);
-  if (r_cell.is_error()) {
-    builder["object"] ["error"] = r_cell.move_as_error().to_string();
-    return builder.ExtractValue();
+    void store(td::JsonValueScope* scope) const {
+      auto jo = scope->enter_object();
+      jo("b64", td::JsonString(td::base64_encode(data_)));
+      jo("len", static_cast<td::int32>(bits_));
+    }
+
+  private:
+    td::Slice data_;
+    unsigned bits_;
+  };
+
+  td::Ref<vm::Cell> cell_;
+};
+
+// cell and slice entries: the boc itself and its parsed cell tree
+class JsonStackBoc final : public td::Jsonable {
+public:
+  explicit JsonStackBoc(td::Slice boc) : boc_(boc) {}
+
+  void store(td::JsonValueScope* scope) const {
+    auto jo = scope->enter_object();
+    jo("bytes", td::JsonString(td::base64_encode(boc_)));
+    auto r_cell = vm::std_boc_deserialize(boc_);
+    if (r_cell.is_error()) {
+      jo("object", JsonError(r_cell.move_as_error().to_string()));
+      return;
+    }
+    jo("object", JsonCell(r_cell.move_as_ok()));
   }
-  auto cell = r_cell.move_as_ok();
-  builder["object"] = serialize_cell(cell);
 
-  return builder.ExtractValue();
-}
+private:
+  class JsonError final : public td::Jsonable {
+  public:
+    explicit JsonError(std::string error) : error_(std::move(error)) {}
 
+    void store(td::JsonValueScope* scope) const {
+      auto jo = scope->enter_object();
+      jo("error", td::JsonString(error_));
+    }
 
-std::string serialize_data_cell(td::Ref<vm::DataCell>& cell) {
-  auto size = (cell->get_bits() + 7) / 8;
-  std::string result;
-  result.resize(size);
-  std::memcpy(result.data(), cell->get_data(), size);
-  return result;
-}
+  private:
+    std::string error_;
+  };
 
-userver::formats::json::Value ton_http::utils::serialize_cell(td::Ref<vm::Cell>& cell) {
-  using namespace userver::formats::json;
-  ValueBuilder builder;
-
-  bool is_special = false;
-  auto cs = vm::load_cell_slice_special(cell, is_special);
-  auto r_ls = cell->load_cell();
-  if (r_ls.is_error()) {
-    builder["error"] = r_ls.move_as_error().to_string();
-    return builder.ExtractValue();
+  td::Slice boc_;
+};
+
+class JsonStackEntry final : public td::Jsonable {
+public:
+  explicit JsonStackEntry(tonlib_api::tvm_StackEntry& entry) : entry_(entry) {}
+
+  void store(td::JsonValueScope* scope) const {
+    auto ja = scope->enter_array();
+    tonlib_api::downcast_call(entry_, td::overloaded(
+      [&](tonlib_api::tvm_stackEntryCell& val) {
+        ja("cell");
+        ja(JsonStackBoc(val.cell_->bytes_));
+      },
+      [&](tonlib_api::tvm_stackEntrySlice& val) {
+        ja("cell");
+        ja(JsonStackBoc(val.slice_->bytes_));
+      },
+      [&](tonlib_api::tvm_stackEntryNumber& val) {
+        ja("num");
+        ja(td::JsonString(ton_http::utils::dec_to_hex_with_prefix(val.number_->number_)));
+      },
+      [&](tonlib_api::tvm_stackEntryTuple& val) {
+        ja("tuple");
+        ja(td::ToJson(val.tuple_));
+      },
+      [&](tonlib_api::tvm_stackEntryList& val) {
+        ja("list");
+        ja(td::ToJson(val.list_));
+      },
+      [&](tonlib_api::tvm_stackEntryUnsupported& val) {
+        ja("unsupported");
+        ja(td::JsonRaw("{}"));
+      }
+    ));
   }
-  auto ls = r_ls.move_as_ok();
-  builder["data"]["b64"] = td::base64_encode(serialize_data_cell(ls.data_cell));
-  builder["data"]["len"] = ls.data_cell->get_bits();
-  builder["refs"] = FromString("[]");
-  builder["special"] = ls.data_cell->is_special();
-
-  while (cs.have_refs(1)) {
-    cs.advance(1);
-    auto loc = cs.fetch_ref();
-    builder["refs"].PushBack(serialize_cell(loc));
+
+private:
+  tonlib_api::tvm_StackEntry& entry_;
+};
+}  // namespace
+
+void ton_http::utils::JsonTvmStack::store(td::JsonValueScope* scope) const {
+  auto ja = scope->enter_array();
+  for (const auto& entry : stack_) {
+    ja(JsonStackEntry(*entry));
   }
-  return builder.ExtractValue();
 }
 
 td::Result<std::string> ton_http::utils::address_from_cell(std::string data) {
@@ -297,45 +370,47 @@ td::Result<std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>> ton_
   return std::move(stack);
 }
 
-userver::formats::json::Value ton_http::utils::serialize_tvm_stack(
-    std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& tvm_stack
+std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> ton_http::utils::clone_stack(
+    const std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& stack
 ) {
-  using namespace userver::formats::json;
-  ValueBuilder builder;
-  for (auto & entry : tvm_stack) {
-    ValueBuilder entry_builder;
-    tonlib_api::downcast_call(*entry, td::overloaded(
-      [&](tonlib_api::tvm_stackEntryCell& val) {
-        entry_builder.PushBack("cell");
-        auto res = serialize_tvm_entry(val);
-        entry_builder.PushBack(res);
-      },
-      [&](tonlib_api::tvm_stackEntrySlice& val) {
-        entry_builder.PushBack("cell");
-        auto res = serialize_tvm_entry(val);
-        entry_builder.PushBack(res);
-      },
-      [&](tonlib_api::tvm_stackEntryNumber& val) {
-        entry_builder.PushBack("num");
-        auto res = td::string_to_int256(val.number_->number_);
-        entry_builder.PushBack(to_hex_string_with_prefix(res));
-      },
-      [&](tonlib_api::tvm_stackEntryTuple& val) {
-        entry_builder.PushBack("tuple");
-        entry_builder.PushBack(FromString(td::json_encode<td::string>(td::ToJson(val.tuple_))));
-      },
-      [&](tonlib_api::tvm_stackEntryList& val) {
-        entry_builder.PushBack("list");
-        entry_builder.PushBack(FromString(td::json_encode<td::string>(td::ToJson(val.list_))));
-      },
-      [&](tonlib_api::tvm_stackEntryUnsupported& val) {
-        entry_builder.PushBack("unsupported");
-        entry_builder.PushBack(FromString("{}"));
-      }
-      ));
-    builder.PushBack(entry_builder.ExtractValue());
+  std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> res;
+  res.reserve(stack.size());
+  for (const auto& entry : stack) {
+    tonlib_api::downcast_call(
+        *entry,
+        td::overloaded(
+            [&](tonlib_api::tvm_stackEntryNumber& e) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntryNumber>(
+                  tonlib_api::make_object<tonlib_api::tvm_numberDecimal>(e.number_->number_)
+              ));
+            },
+            [&](tonlib_api::tvm_stackEntryCell& e) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntryCell>(
+                  tonlib_api::make_object<tonlib_api::tvm_cell>(e.cell_->bytes_)
+              ));
+            },
+            [&](tonlib_api::tvm_stackEntrySlice& e) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntrySlice>(
+                  tonlib_api::make_object<tonlib_api::tvm_slice>(e.slice_->bytes_)
+              ));
+            },
+            [&](tonlib_api::tvm_stackEntryTuple& e) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntryTuple>(
+                  tonlib_api::make_object<tonlib_api::tvm_tuple>(clone_stack(e.tuple_->elements_))
+              ));
+            },
+            [&](tonlib_api::tvm_stackEntryList& e) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntryList>(
+                  tonlib_api::make_object<tonlib_api::tvm_list>(clone_stack(e.list_->elements_))
+              ));
+            },
+            [&](tonlib_api::tvm_stackEntryUnsupported&) {
+              res.push_back(tonlib_api::make_object<tonlib_api::tvm_stackEntryUnsupported>());
+            }
+        )
+    );
   }
-  return builder.ExtractValue();
+  return res;
 }
 
 td::Result<std::string> ton_http::utils::parse_snake_data(td::Ref<vm::CellSlice> data) {
@@ -3,6 +3,7 @@
 #include <auto/tl/tonlib_api_json.h>
 #include <string>
 #include <userver/formats/json.hpp>
+#include "td/utils/JsonBuilder.h"
 #include "td/utils/Status.h"
 #include "vm/cells/Cell.h"
 #include "vm/cells/CellSlice.h"
@@ -82,13 +83,24 @@ inline std::optional<std::string> stringToHash(const std::string& str) {
 td::Result<userver::formats::json::Value> render_tvm_stack(const std::string& stack_str);
 td::Result<userver::formats::json::Value> render_tvm_element(const std::string& element_type, const userver::formats::json::Value& element);
 
-userver::formats::json::Value serialize_tvm_stack(std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& tvm_stack);
-userver::formats::json::Value serialize_tvm_entry(tonlib_api::tvm_stackEntryCell& entry);
-userver::formats::json::Value serialize_tvm_entry(tonlib_api::tvm_stackEntrySlice& entry);
+// "0x"-prefixed hex form of a decimal tvm number
+std::string dec_to_hex_with_prefix(td::Slice dec);
 
-td::Result<std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>> parse_stack(const std::vector<std::string>& stack_vector);
+// writes a tvm stack in the runGetMethod response format straight into a td::JsonBuilder
+class JsonTvmStack final : public td::Jsonable {
+public:
+  explicit JsonTvmStack(const std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& stack) : stack_(stack) {}
+  void store(td::JsonValueScope* scope) const;
+
+private:
+  const std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& stack_;
+};
 
-userver::formats::json::Value serialize_cell(td::Ref<vm::Cell>& cell);
+td::Result<std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>> parse_stack(const std::vector<std::string>& stack_vector);
+// deep copy of a tvm stack, tonlib consumes the stack of every request it gets
+std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>> clone_stack(
+    const std::vector<tonlib_api::object_ptr<tonlib_api::tvm_StackEntry>>& stack
+);
 
 td::Result<std::string> address_from_cell(std::string data);
 
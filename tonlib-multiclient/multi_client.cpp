@@ -10,6 +10,7 @@ namespace multiclient {
 
 MultiClient::MultiClient(MultiClientConfig config, std::unique_ptr<ResponseCallback> callback) :
     config_(std::move(config)),
+    consensus_block_(std::make_shared<std::atomic<std::int32_t>>(0)),
     scheduler_(
         std::make_shared<td::actor::Scheduler>(std::vector<td::actor::Scheduler::NodeInfo>{config.scheduler_threads})
     ) {
@@ -22,7 +23,8 @@ MultiClient::MultiClient(MultiClientConfig config, std::unique_ptr<ResponseCallb
             .blockchain_name = config_.blockchain_name,
             .reset_key_store = config_.reset_key_store,
         },
-        std::move(cb)
+        std::move(cb),
+        consensus_block_
     );
   });
   scheduler_thread_ = std::thread([scheduler = scheduler_] { scheduler->run(); });
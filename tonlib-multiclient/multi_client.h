@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
 #include <future>
 #include <memory>
@@ -40,9 +41,14 @@ public:
   void send_callback_request(RequestCallback req) const;
 
   td::Result<std::int32_t> get_consensus_block() const;
+  // last consensus masterchain seqno observed by alive checks, 0 if unknown; doesn't touch the actor
+  std::int32_t get_last_consensus_block() const {
+    return consensus_block_->load(std::memory_order_acquire);
+  }
   td::Result<SessionPtr> get_session(const RequestParameters& options, SessionPtr&& session) const;
 private:
   const MultiClientConfig config_;
+  std::shared_ptr<std::atomic<std::int32_t>> consensus_block_;
   std::shared_ptr<td::actor::Scheduler> scheduler_;
   std::thread scheduler_thread_;
   td::actor::ActorOwn<MultiClientActor> client_;
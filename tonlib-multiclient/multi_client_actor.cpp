@@ -230,6 +230,7 @@ void MultiClientActor::on_alive_checked(size_t worker_index, std::optional<int32
   if (is_alive) {
     worker.last_mc_seqno = last_mc_seqno_value;
     worker.check_retry_count = 0;
+    update_consensus_block();
   } else {
     worker.check_retry_after = td::Timestamp::in(kRetryInterval);
   }
@@ -276,13 +277,30 @@ void MultiClientActor::on_archival_checked(size_t worker_index, bool is_archival
   LOG(DEBUG) << "LS #" << worker_index << " archival: " << is_archival;
   workers_[worker_index].is_archival = is_archival;
 }
-void MultiClientActor::get_consensus_block(td::Promise<std::int32_t>&& promise) {
+std::int32_t MultiClientActor::calc_consensus_block() const {
   std::int32_t consensus_block = 0;
   for (const auto& worker : workers_) {
     if (worker.is_alive && worker.last_mc_seqno > consensus_block) {
       consensus_block = worker.last_mc_seqno;
     }
   }
+  return consensus_block;
+}
+
+void MultiClientActor::update_consensus_block() {
+  if (!consensus_block_) {
+    return;
+  }
+  // published value never goes back, so readers may use it as a monotonic head marker
+  auto consensus_block = calc_consensus_block();
+  if (consensus_block > consensus_block_->load(std::memory_order_relaxed)) {
+    LOG(DEBUG) << "new consensus block: " << consensus_block;
+    consensus_block_->store(consensus_block, std::memory_order_release);
+  }
+}
+
+void MultiClientActor::get_consensus_block(td::Promise<std::int32_t>&& promise) {
+  auto consensus_block = calc_consensus_block();
   if (consensus_block == 0) {
     promise.set_error(td::Status::Error(500, "no workers alive"));
     return;
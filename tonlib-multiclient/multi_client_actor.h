@@ -1,5 +1,6 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <filesystem>
 #include <optional>
@@ -28,8 +29,12 @@ struct MultiClientActorConfig {
 
 class MultiClientActor : public td::actor::Actor {
 public:
-  explicit MultiClientActor(MultiClientActorConfig config, std::unique_ptr<ResponseCallback> callback = nullptr) :
-      config_(std::move(config)), callback_(callback.release()) {
+  explicit MultiClientActor(
+      MultiClientActorConfig config,
+      std::unique_ptr<ResponseCallback> callback = nullptr,
+      std::shared_ptr<std::atomic<std::int32_t>> consensus_block = nullptr
+  ) :
+      config_(std::move(config)), callback_(callback.release()), consensus_block_(std::move(consensus_block)) {
   }
 
   void start_up() final;
@@ -107,8 +112,12 @@ private:
   void check_archival(std::optional<size_t> check_worker_index = std::nullopt);
   void on_archival_checked(size_t worker_index, bool is_archival);
 
+  std::int32_t calc_consensus_block() const;
+  void update_consensus_block();
+
   const MultiClientActorConfig config_;
   std::shared_ptr<ResponseCallback> callback_;
+  std::shared_ptr<std::atomic<std::int32_t>> consensus_block_;
   std::vector<WorkerInfo> workers_;
   bool first_archival_check_done_ = false;
   td::Timestamp next_archival_check_ = td::Timestamp::now();